@@ -0,0 +1,271 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string_view>
+
+#include <libhal/i2c.hpp>
+#include <libhal/output_pin.hpp>
+#include <libhal/spi.hpp>
+
+namespace hal::stm_imu::benchmark {
+
+/**
+ * @brief Keeps the compiler from optimizing away the value being benchmarked
+ */
+template<typename T>
+void do_not_optimize(T const& p_value)
+{
+  asm volatile("" : : "r,m"(p_value) : "memory");
+}
+
+/**
+ * @brief Hides a pointer's target from the optimizer
+ *
+ * Calls made through the returned pointer cannot be devirtualized, which
+ * keeps a benchmark of a virtual call honest.
+ */
+template<typename T>
+T* opaque(T* p_pointer)
+{
+  asm volatile("" : "+r"(p_pointer));
+  return p_pointer;
+}
+
+/**
+ * @brief Returns the processor's time stamp counter, or 0 if the host has no
+ * counter readable from user space
+ */
+inline std::uint64_t cycle_counter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Runs p_function p_iterations times and prints the average time
+ *
+ * The average number of time stamp counter cycles per call is printed as well
+ * on hosts that provide one.
+ *
+ * @return double - average nanoseconds per call
+ */
+template<typename Function>
+double measure(std::string_view p_name,
+               std::size_t p_iterations,
+               Function&& p_function)
+{
+  // warm up caches and branch predictors before timing
+  for (std::size_t i = 0; i < p_iterations / 10; i++) {
+    p_function();
+  }
+
+  auto const start_cycles = cycle_counter();
+  auto const start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < p_iterations; i++) {
+    p_function();
+  }
+  auto const stop = std::chrono::steady_clock::now();
+  auto const stop_cycles = cycle_counter();
+
+  auto const elapsed = std::chrono::duration<double, std::nano>(stop - start);
+  auto const average = elapsed.count() / static_cast<double>(p_iterations);
+  std::printf("%-48.*s %10.2f ns",
+              static_cast<int>(p_name.size()),
+              p_name.data(),
+              average);
+  if (stop_cycles != start_cycles) {
+    auto const cycles = static_cast<double>(stop_cycles - start_cycles);
+    std::printf(" %10.1f cycles", cycles / static_cast<double>(p_iterations));
+  }
+  std::puts("");
+  return average;
+}
+
+/**
+ * @brief A stand-in for the device's register file
+ *
+ * Returns 0x33 for WHO_AM_I and cycles through a fixed set of samples for
+ * every other register, without modelling any timing or FIFO behavior. This
+ * keeps the cost of the mock bus as small as possible so the benchmark
+ * measures the driver.
+ */
+class register_file
+{
+public:
+  hal::byte read(hal::byte p_address)
+  {
+    constexpr hal::byte who_am_i_register = 0x0F;
+    constexpr hal::byte who_am_i = 0x33;
+    if (p_address == who_am_i_register) {
+      return who_am_i;
+    }
+    m_index = (m_index + 1) % m_pattern.size();
+    return m_pattern[m_index];
+  }
+
+  /// Number of bus transactions seen by the mock
+  std::size_t transactions = 0;
+  /// Number of hal::spi::transfer calls seen by the mock
+  std::size_t transfers = 0;
+
+private:
+  std::array<hal::byte, 12> m_pattern{ 0x40, 0x12, 0xC0, 0xF3, 0x00, 0x40,
+                                       0x80, 0x01, 0x40, 0xFE, 0xC0, 0x3F };
+  std::size_t m_index = 0;
+};
+
+/**
+ * @brief Mock I2C bus backed by a register_file
+ */
+class mock_i2c : public hal::i2c
+{
+public:
+  explicit mock_i2c(register_file& p_registers)
+    : m_registers(&p_registers)
+  {
+  }
+
+private:
+  void driver_configure(settings const&) override
+  {
+  }
+
+  void driver_transaction(hal::byte,
+                          std::span<hal::byte const> p_data_out,
+                          std::span<hal::byte> p_data_in,
+                          hal::function_ref<hal::timeout_function>) override
+  {
+    m_registers->transactions++;
+    hal::byte address = p_data_out.empty() ? 0 : (p_data_out[0] & 0x7F);
+    for (auto& byte : p_data_in) {
+      byte = m_registers->read(address);
+    }
+  }
+
+  register_file* m_registers;
+};
+
+/**
+ * @brief Mock SPI bus and chip select backed by a register_file
+ */
+class mock_spi
+  : public hal::spi
+  , public hal::output_pin
+{
+public:
+  explicit mock_spi(register_file& p_registers)
+    : m_registers(&p_registers)
+  {
+  }
+
+  hal::output_pin& chip_select()
+  {
+    return *this;
+  }
+
+private:
+  void driver_configure(hal::spi::settings const&) override
+  {
+  }
+
+  void driver_configure(hal::output_pin::settings const&) override
+  {
+  }
+
+  void driver_level(bool p_high) override
+  {
+    if (not p_high) {
+      m_registers->transactions++;
+      m_command_pending = true;
+    }
+  }
+
+  bool driver_level() override
+  {
+    return true;
+  }
+
+  void driver_transfer(std::span<hal::byte const> p_data_out,
+                       std::span<hal::byte> p_data_in,
+                       hal::byte) override
+  {
+    m_registers->transfers++;
+    std::size_t i = 0;
+    if (m_command_pending && not p_data_out.empty()) {
+      m_address = p_data_out[0] & 0x3F;
+      m_command_pending = false;
+      i = 1;
+    }
+    for (; i < p_data_in.size(); i++) {
+      p_data_in[i] = m_registers->read(m_address);
+    }
+  }
+
+  register_file* m_registers;
+  hal::byte m_address = 0;
+  bool m_command_pending = false;
+};
+
+/**
+ * @brief Non-virtual lis3dhtr_core transport backed by a register_file
+ *
+ * Counts transactions like the mock buses, but without a hal::i2c or hal::spi
+ * interface between the driver and the register file, so the whole read path
+ * is visible to the compiler.
+ */
+class counting_transport
+{
+public:
+  static constexpr std::uint32_t chip_selects_per_transaction = 0;
+
+  explicit counting_transport(register_file& p_registers)
+    : m_registers(&p_registers)
+  {
+  }
+
+  static constexpr hal::byte read_command(hal::byte p_register)
+  {
+    return p_register;
+  }
+
+  static constexpr hal::byte write_command(hal::byte p_register)
+  {
+    return p_register;
+  }
+
+  void transaction(std::span<hal::byte const> p_data_out,
+                   std::span<hal::byte> p_data_in)
+  {
+    m_registers->transactions++;
+    hal::byte address = p_data_out.empty() ? 0 : p_data_out[0];
+    for (auto& byte : p_data_in) {
+      byte = m_registers->read(address);
+    }
+  }
+
+private:
+  register_file* m_registers;
+};
+}  // namespace hal::stm_imu::benchmark
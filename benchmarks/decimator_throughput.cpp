@@ -0,0 +1,75 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cstdio>
+#include <string_view>
+
+#include <libhal-stm-imu/decimator.hpp>
+#include <libhal-stm-imu/lis3dhtr_core.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+using sample_t = lis3dhtr::raw_read_t;
+
+constexpr std::size_t bursts = 1'000'000;
+
+/**
+ * @brief Feeds full FIFO bursts of 32 samples through a decimator
+ *
+ * Each call processes one burst, the way a FIFO drain would hand it over.
+ */
+template<typename Decimator>
+void benchmark_decimator(std::string_view p_name)
+{
+  std::array<sample_t, lis3dhtr::fifo_depth> burst{};
+  for (std::size_t i = 0; i < burst.size(); i++) {
+    auto const value = static_cast<std::int16_t>((i * 37) % 512 - 256);
+    burst[i] = sample_t{
+      .x = value,
+      .y = static_cast<std::int16_t>(-value),
+      .z = 1000,
+      .full_scale = lis3dhtr::max_acceleration::g2,
+      .resolution = 12,
+    };
+  }
+
+  Decimator decimator;
+  std::array<typename Decimator::output_t,
+             Decimator::max_outputs(lis3dhtr::fifo_depth)>
+    output{};
+
+  auto const nanoseconds = measure(p_name, bursts, [&] {
+    do_not_optimize(decimator.process(burst, output));
+  });
+
+  std::printf("  %-46s %10.2f Msamples/s\n",
+              "input rate",
+              static_cast<double>(burst.size()) / nanoseconds * 1e3);
+}
+}  // namespace
+
+int main()
+{
+  std::printf("decimator, %zu bursts of %zu samples\n",
+              bursts,
+              lis3dhtr::fifo_depth);
+  benchmark_decimator<decimator<9, 3>>("decimator<9, 3> float");
+  benchmark_decimator<decimator<9, 3, sample_t>>("decimator<9, 3> Q15");
+  benchmark_decimator<decimator<36, 3>>("decimator<36, 3> float");
+  benchmark_decimator<decimator<36, 3, sample_t>>("decimator<36, 3> Q15");
+}
@@ -0,0 +1,124 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+#include <libhal-stm-imu/vibration_spectrum.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+
+constexpr std::size_t transforms = 4'000;
+constexpr std::size_t rounds = 7;
+
+/**
+ * @brief Loads a full frame with set() then runs transform()
+ *
+ * The frame is reloaded before every transform so the Q15 variants always
+ * start from in-range data.
+ */
+template<std::size_t Points, typename Sample, fft_layout Layout>
+class fft_case
+{
+public:
+  fft_case()
+  {
+    for (std::size_t n = 0; n < Points; n++) {
+      m_frame[n] = static_cast<Sample>((n * 7919) % 8192) - Sample{ 4096 };
+    }
+  }
+
+  /// Returns the average nanoseconds per transform over one round
+  double time_round()
+  {
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < transforms; i++) {
+      for (std::size_t n = 0; n < Points; n++) {
+        m_fft.set(n, m_frame[n]);
+      }
+      m_fft.transform();
+      do_not_optimize(m_fft.magnitude(1));
+    }
+    auto const stop = std::chrono::steady_clock::now();
+    auto const elapsed = std::chrono::duration<double, std::nano>(stop - start);
+    return elapsed.count() / static_cast<double>(transforms);
+  }
+
+private:
+  real_fft<Points, Sample, Layout> m_fft;
+  std::array<Sample, Points> m_frame{};
+};
+
+/**
+ * @brief Times both layouts in alternating rounds and prints the fastest
+ * round of each
+ *
+ * Alternating the layouts exposes both to the same frequency scaling and
+ * background load, and the fastest round is the one least disturbed by
+ * them. Differences of a few percent are still within the noise of a shared
+ * host.
+ */
+template<std::size_t Points, typename Sample>
+void benchmark_layouts(char const* p_sample_name)
+{
+  fft_case<Points, Sample, fft_layout::interleaved> interleaved;
+  fft_case<Points, Sample, fft_layout::split> split;
+  interleaved.time_round();
+  split.time_round();
+
+  auto interleaved_best = std::numeric_limits<double>::max();
+  auto split_best = std::numeric_limits<double>::max();
+  for (std::size_t round = 0; round < rounds; round++) {
+    interleaved_best = std::min(interleaved_best, interleaved.time_round());
+    split_best = std::min(split_best, split.time_round());
+  }
+
+  std::printf("  %4zu %-5s %14.0f ns %14.0f ns %8.2f\n",
+              Points,
+              p_sample_name,
+              interleaved_best,
+              split_best,
+              split_best / interleaved_best);
+}
+
+template<std::size_t Points>
+void benchmark_size()
+{
+  benchmark_layouts<Points, float>("float");
+  benchmark_layouts<Points, std::int16_t>("Q15");
+}
+}  // namespace
+
+int main()
+{
+  std::printf("real_fft, load and transform, fastest of %zu rounds of %zu\n",
+              rounds,
+              transforms);
+  std::printf("  %-10s %17s %17s %8s\n",
+              "points",
+              "interleaved",
+              "split",
+              "ratio");
+  benchmark_size<256>();
+  benchmark_size<512>();
+  benchmark_size<1024>();
+}
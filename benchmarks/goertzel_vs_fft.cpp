@@ -0,0 +1,84 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <libhal-stm-imu/goertzel.hpp>
+#include <libhal-stm-imu/lis3dhtr_core.hpp>
+#include <libhal-stm-imu/vibration_spectrum.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+using sample_t = lis3dhtr::raw_read_t;
+
+constexpr std::size_t points = 256;
+constexpr std::size_t frames = 20'000;
+
+std::vector<sample_t> frame()
+{
+  std::vector<sample_t> samples(points);
+  for (std::size_t n = 0; n < points; n++) {
+    auto const value = static_cast<std::int16_t>((n * 7919) % 1024 - 512);
+    samples[n] = sample_t{
+      .x = value,
+      .y = static_cast<std::int16_t>(-value),
+      .z = 1000,
+      .full_scale = lis3dhtr::max_acceleration::g2,
+      .resolution = 12,
+    };
+  }
+  return samples;
+}
+
+/**
+ * @brief Times one frame of FIFO bursts through an analyzer, per frame
+ */
+template<typename Analyzer>
+void benchmark_frame(std::string const& p_name)
+{
+  auto const samples = frame();
+  Analyzer analyzer;
+
+  measure(p_name, frames, [&] {
+    for (std::size_t offset = 0; offset < points;
+         offset += lis3dhtr::fifo_depth) {
+      do_not_optimize(analyzer.add(
+        std::span(samples).subspan(offset, lis3dhtr::fifo_depth)));
+    }
+  });
+}
+}  // namespace
+
+int main()
+{
+  std::printf("%zu sample frames, 3 axes, %zu frames\n", points, frames);
+  benchmark_frame<goertzel<points, 10>>("  goertzel, 1 bin");
+  benchmark_frame<goertzel<points, 10, 20, 30, 40>>("  goertzel, 4 bins");
+  benchmark_frame<goertzel<points, 10, 20, 30, 40, 50, 60, 70, 80>>(
+    "  goertzel, 8 bins");
+  benchmark_frame<goertzel_fixed<points, 10>>("  goertzel_fixed, 1 bin");
+  benchmark_frame<goertzel_fixed<points, 10, 20, 30, 40>>(
+    "  goertzel_fixed, 4 bins");
+  benchmark_frame<goertzel_fixed<points, 10, 20, 30, 40, 50, 60, 70, 80>>(
+    "  goertzel_fixed, 8 bins");
+  benchmark_frame<vibration_spectrum<points>>("  vibration_spectrum, float");
+  benchmark_frame<vibration_spectrum<points, std::int16_t>>(
+    "  vibration_spectrum, Q15");
+}
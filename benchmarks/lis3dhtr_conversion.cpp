@@ -0,0 +1,153 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <limits>
+#include <utility>
+
+#include <libhal-stm-imu/lis3dhtr_i2c.hpp>
+#include <libhal-stm-imu/lis3dhtr_spi.hpp>
+#include <libhal-util/i2c.hpp>
+#include <libhal-util/map.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+
+constexpr std::size_t iterations = 2'000'000;
+
+constexpr lis3dhtr::calibration_model calibration{
+  .bias = { 0.03f, -0.02f, 0.05f },
+  .scale = { 0.98f, 1.03f, 0.99f },
+};
+
+constexpr lis3dhtr::calibration_model cross_axis_calibration{
+  .bias = { 0.03f, -0.02f, 0.05f },
+  .scale = { 0.98f, 1.03f, 0.99f },
+  .cross_axis = { {
+    { 1.0f, -0.02f, 0.01f },
+    { 0.03f, 1.0f, -0.01f },
+    { 0.02f, 0.01f, 1.0f },
+  } },
+};
+
+/**
+ * @brief The per sample conversion driver_read() performed before the
+ * sensitivity was precomputed, kept as the baseline for this benchmark.
+ */
+hal::accelerometer::read_t legacy_convert(std::span<hal::byte const> p_data,
+                                          hal::byte p_gscale)
+{
+  auto const combine = [p_data](std::size_t p_axis) {
+    return static_cast<std::int16_t>(p_data[p_axis * 2] |
+                                     (p_data[p_axis * 2 + 1] << 8));
+  };
+
+  auto output_limits =
+    static_cast<float>(1 << (static_cast<int16_t>(p_gscale) + 1));
+
+  constexpr auto max = static_cast<float>(std::numeric_limits<int16_t>::max());
+  constexpr auto min = static_cast<float>(std::numeric_limits<int16_t>::min());
+
+  auto input_range = std::make_pair(max, min);
+  auto output_range = std::make_pair(-output_limits, output_limits);
+
+  return hal::accelerometer::read_t{
+    .x = hal::map(combine(0), input_range, output_range),
+    .y = hal::map(combine(1), input_range, output_range),
+    .z = hal::map(combine(2), input_range, output_range),
+  };
+}
+
+void benchmark_i2c()
+{
+  register_file registers;
+  mock_i2c i2c(registers);
+  lis3dhtr_i2c lis(i2c);
+
+  std::puts("lis3dhtr_i2c");
+
+  measure("  before: burst read + hal::map per axis", iterations, [&] {
+    auto data = hal::write_then_read<6>(i2c,
+                                        lis3dhtr_i2c::low_address,
+                                        std::array<hal::byte, 1>{ 0xA8 },
+                                        hal::never_timeout());
+    do_not_optimize(legacy_convert(data, 0));
+  });
+
+  measure("  after:  read() with precomputed sensitivity", iterations, [&] {
+    do_not_optimize(lis.read());
+  });
+
+  lis.configure_calibration(calibration);
+  measure("  read() with bias and scale calibration", iterations, [&] {
+    do_not_optimize(lis.read());
+  });
+
+  lis.configure_calibration(cross_axis_calibration);
+  measure("  read() with cross axis calibration", iterations, [&] {
+    do_not_optimize(lis.read());
+  });
+
+  measure("  read_raw() (no float conversion)", iterations, [&] {
+    do_not_optimize(lis.read_raw());
+  });
+}
+
+void benchmark_spi()
+{
+  register_file registers;
+  mock_spi spi(registers);
+  lis3dhtr_spi lis(spi, spi.chip_select());
+
+  std::puts("lis3dhtr_spi");
+
+  // framed exactly like lis3dhtr_spi::read(), a single full-duplex transfer
+  // under one chip select, so only the conversion differs between the cases
+  measure("  before: burst read + hal::map per axis", iterations, [&] {
+    std::array<hal::byte, 7> frame{};
+    spi.chip_select().level(false);
+    spi.transfer(std::array<hal::byte, 1>{ 0xE8 }, frame);
+    spi.chip_select().level(true);
+    do_not_optimize(legacy_convert(std::span(frame).subspan(1), 0));
+  });
+
+  measure("  after:  read() with precomputed sensitivity", iterations, [&] {
+    do_not_optimize(lis.read());
+  });
+
+  lis.configure_calibration(calibration);
+  measure("  read() with bias and scale calibration", iterations, [&] {
+    do_not_optimize(lis.read());
+  });
+
+  lis.configure_calibration(cross_axis_calibration);
+  measure("  read() with cross axis calibration", iterations, [&] {
+    do_not_optimize(lis.read());
+  });
+
+  measure("  read_raw() (no float conversion)", iterations, [&] {
+    do_not_optimize(lis.read_raw());
+  });
+}
+}  // namespace
+
+int main()
+{
+  std::puts("Average time per sample, mock bus overhead included\n");
+  benchmark_i2c();
+  benchmark_spi();
+}
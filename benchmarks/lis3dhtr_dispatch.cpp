@@ -0,0 +1,103 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+
+#include <libhal-stm-imu/lis3dhtr_core.hpp>
+#include <libhal-stm-imu/lis3dhtr_i2c.hpp>
+#include <libhal-stm-imu/lis3dhtr_spi.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+
+constexpr std::size_t iterations = 2'000'000;
+
+void print_transactions(register_file const& p_registers,
+                        std::size_t p_before,
+                        std::size_t p_reads)
+{
+  auto const transactions = p_registers.transactions - p_before;
+  std::printf("  %-46s %10.2f\n",
+              "bus transactions per read",
+              static_cast<double>(transactions) / static_cast<double>(p_reads));
+}
+
+void benchmark_i2c()
+{
+  register_file registers;
+  mock_i2c i2c(registers);
+  lis3dhtr_i2c adapter(i2c);
+  lis3dhtr_i2c_core core(
+    lis3dhtr_i2c_transport(i2c, lis3dhtr_i2c::low_address),
+    lis3dhtr_i2c_core::settings{});
+
+  std::puts("lis3dhtr_i2c");
+
+  auto* accelerometer = opaque<hal::accelerometer>(&adapter);
+  measure("  hal::accelerometer::read() (virtual)", iterations, [&] {
+    do_not_optimize(accelerometer->read());
+  });
+
+  measure("  lis3dhtr_i2c_core::read() (inline)", iterations, [&] {
+    do_not_optimize(core.read());
+  });
+}
+
+void benchmark_spi()
+{
+  register_file registers;
+  mock_spi spi(registers);
+  lis3dhtr_spi adapter(spi, spi.chip_select());
+  lis3dhtr_spi_core core(lis3dhtr_spi_transport(spi, spi.chip_select()),
+                         lis3dhtr_spi_core::settings{});
+
+  std::puts("lis3dhtr_spi");
+
+  auto* accelerometer = opaque<hal::accelerometer>(&adapter);
+  measure("  hal::accelerometer::read() (virtual)", iterations, [&] {
+    do_not_optimize(accelerometer->read());
+  });
+
+  measure("  lis3dhtr_spi_core::read() (inline)", iterations, [&] {
+    do_not_optimize(core.read());
+  });
+}
+
+void benchmark_counting_transport()
+{
+  register_file registers;
+  lis3dhtr_core<counting_transport> core(counting_transport(registers),
+                                         lis3dhtr::settings{});
+
+  std::puts("lis3dhtr_core<counting_transport>");
+
+  auto const before = registers.transactions;
+  measure("  read() (no virtual call anywhere)", iterations, [&] {
+    do_not_optimize(core.read());
+  });
+  // measure() runs a tenth of the iterations again to warm up
+  print_transactions(registers, before, iterations + iterations / 10);
+}
+}  // namespace
+
+int main()
+{
+  std::puts("Average time per sample, mock bus overhead included\n");
+  benchmark_i2c();
+  benchmark_spi();
+  benchmark_counting_transport();
+}
@@ -0,0 +1,79 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cstdio>
+#include <string_view>
+
+#include <libhal-stm-imu/lis3dhtr_spi.hpp>
+#include <libhal-util/spi.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+
+constexpr std::size_t iterations = 2'000'000;
+
+/**
+ * @brief Measures p_function and prints the transfer and chip select calls it
+ * made per call
+ */
+template<typename Function>
+void measure_calls(std::string_view p_name,
+                   register_file& p_registers,
+                   Function&& p_function)
+{
+  auto const transfers = p_registers.transfers;
+  auto const transactions = p_registers.transactions;
+
+  measure(p_name, iterations, p_function);
+
+  // measure() runs a tenth of the iterations again to warm up
+  auto const calls = static_cast<double>(iterations + iterations / 10);
+  std::printf("  %-46s %10.2f\n",
+              "spi transfers per call",
+              static_cast<double>(p_registers.transfers - transfers) / calls);
+  std::printf(
+    "  %-46s %10.2f\n",
+    "chip selects per call",
+    static_cast<double>(p_registers.transactions - transactions) / calls);
+}
+}  // namespace
+
+int main()
+{
+  register_file registers;
+  mock_spi spi(registers);
+  lis3dhtr_spi lis(spi, spi.chip_select());
+
+  std::puts("Average time per sample, mock bus overhead included\n");
+  std::puts("lis3dhtr_spi");
+
+  measure_calls("  before: write_then_read(), no parsing", registers, [&] {
+    spi.chip_select().level(false);
+    auto data = hal::write_then_read<6>(spi, std::array<hal::byte, 1>{ 0xE8 });
+    spi.chip_select().level(true);
+    do_not_optimize(data);
+  });
+
+  measure_calls("  after:  read_raw() full-duplex", registers, [&] {
+    do_not_optimize(lis.read_raw());
+  });
+
+  measure_calls("  read_with_status() full-duplex", registers, [&] {
+    do_not_optimize(lis.read_with_status());
+  });
+}
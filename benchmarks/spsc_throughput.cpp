@@ -0,0 +1,103 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <libhal-stm-imu/lis3dhtr_core.hpp>
+#include <libhal-stm-imu/spsc_ring_buffer.hpp>
+
+#include "benchmark.hpp"
+
+namespace {
+using namespace hal::stm_imu;
+using namespace hal::stm_imu::benchmark;
+using sample_t = lis3dhtr::raw_read_t;
+
+constexpr std::size_t samples = 20'000'000;
+
+/**
+ * @brief Streams samples from a producer thread to the calling thread
+ *
+ * The producer stands in for the data ready interrupt and the caller for the
+ * task draining the buffer. Every sample is checked on arrival so a lost or
+ * reordered sample aborts the benchmark.
+ *
+ * @param p_batch_size - the number of samples requested per pop_batch() call
+ */
+void benchmark_batch(std::size_t p_batch_size)
+{
+  std::array<sample_t, 256> storage{};
+  spsc_ring_buffer<sample_t> buffer(storage);
+  std::vector<sample_t> batch(p_batch_size);
+
+  auto const start = std::chrono::steady_clock::now();
+
+  std::thread producer([&buffer]() {
+    for (std::size_t i = 0; i < samples; i++) {
+      auto const sample = sample_t{
+        .x = static_cast<std::int16_t>(i),
+        .y = 0,
+        .z = 0,
+        .full_scale = lis3dhtr::max_acceleration::g2,
+        .resolution = 10,
+      };
+      while (not buffer.push(sample)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::size_t received = 0;
+  std::size_t calls = 0;
+  while (received < samples) {
+    auto const popped = buffer.pop_batch(batch);
+    if (popped.empty()) {
+      std::this_thread::yield();
+    }
+    for (auto const& sample : popped) {
+      if (sample.x != static_cast<std::int16_t>(received)) {
+        std::printf("sample %zu lost or out of order\n", received);
+        std::abort();
+      }
+      received++;
+    }
+    calls++;
+  }
+  producer.join();
+
+  auto const stop = std::chrono::steady_clock::now();
+  auto const seconds = std::chrono::duration<double>(stop - start).count();
+
+  std::printf("  pop_batch() of up to %3zu %20.2f Msamples/s %8.2f per call\n",
+              p_batch_size,
+              static_cast<double>(samples) / seconds / 1e6,
+              static_cast<double>(samples) / static_cast<double>(calls));
+  do_not_optimize(received);
+}
+}  // namespace
+
+int main()
+{
+  std::printf("spsc_ring_buffer, %zu samples, producer and consumer threads\n",
+              samples);
+  for (std::size_t const batch_size : { 1, 8, 32, 128 }) {
+    benchmark_batch(batch_size);
+  }
+}
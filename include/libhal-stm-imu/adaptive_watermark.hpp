@@ -0,0 +1,168 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include <libhal/units.hpp>
+
+namespace hal::stm_imu {
+/**
+ * @brief Chooses the FIFO watermark level that wakes the consumer as rarely
+ * as possible without losing samples
+ *
+ * The watermark interrupt is raised once more than watermark() samples are
+ * stored. Every sample found in the FIFO beyond that point arrived while the
+ * consumer was responding to the interrupt, so the stored count reported by
+ * FIFO_SRC measures the consumer's latency in samples without needing a
+ * clock. The policy keeps enough room above the watermark for the worst
+ * latency seen recently plus a safety margin.
+ *
+ * A full FIFO (overrun) means samples may have been lost and the real latency
+ * is unknown, so the reserved room is doubled. After decay_interval wakeups
+ * without an overrun, the reserved room shrinks by one sample, slowly raising
+ * the watermark back toward the top of the FIFO.
+ */
+class adaptive_watermark
+{
+public:
+  /**
+   * @brief The number of samples the device FIFO can hold
+   */
+  static constexpr std::size_t fifo_depth = 32;
+  /**
+   * @brief The largest watermark the FTH field can hold
+   */
+  static constexpr hal::byte max_watermark = fifo_depth - 1;
+
+  /**
+   * @brief settings for the adaptive watermark policy
+   */
+  struct settings
+  {
+    /**
+     * @brief Samples of latency to reserve room for before any latency has
+     * been measured
+     */
+    hal::byte initial_latency = 4;
+    /**
+     * @brief Samples kept free on top of the worst measured latency
+     */
+    hal::byte margin = 2;
+    /**
+     * @brief Number of consecutive wakeups without an overrun before the
+     * reserved room shrinks by one sample
+     */
+    std::size_t decay_interval = 16;
+  };
+
+  /**
+   * @brief Constructs the policy with the default settings
+   */
+  adaptive_watermark()
+    : adaptive_watermark(settings{})
+  {
+  }
+
+  /**
+   * @brief Constructs the policy
+   *
+   * @param p_settings - initial latency estimate, safety margin and decay rate
+   */
+  explicit adaptive_watermark(settings const& p_settings)
+    : m_settings(p_settings)
+    , m_latency(std::min(p_settings.initial_latency, max_watermark))
+  {
+    m_watermark = compute_watermark();
+  }
+
+  /**
+   * @brief Returns the watermark level to program into FIFO_CTRL_REG
+   */
+  [[nodiscard]] hal::byte watermark() const
+  {
+    return m_watermark;
+  }
+
+  /**
+   * @brief Returns the number of samples of latency currently reserved
+   */
+  [[nodiscard]] hal::byte latency() const
+  {
+    return m_latency;
+  }
+
+  /**
+   * @brief Returns the number of wakeups that found the FIFO full
+   */
+  [[nodiscard]] std::size_t overruns() const
+  {
+    return m_overruns;
+  }
+
+  /**
+   * @brief Records the number of samples stored in the FIFO when the consumer
+   * drained it after a watermark interrupt
+   *
+   * @param p_stored - the number of stored samples reported by FIFO_SRC,
+   * fifo_depth when the overrun flag was set
+   * @return hal::byte - the watermark to use from now on
+   */
+  hal::byte update(std::size_t p_stored)
+  {
+    if (p_stored >= fifo_depth) {
+      m_overruns++;
+      m_clean_wakeups = 0;
+      auto const doubled = std::max<std::size_t>(m_latency * 2U, 1U);
+      m_latency = static_cast<hal::byte>(
+        std::min<std::size_t>(doubled, max_watermark));
+    } else {
+      auto const trigger_level = std::size_t{ m_watermark } + 1U;
+      auto const measured =
+        p_stored > trigger_level ? p_stored - trigger_level : 0U;
+
+      if (measured > m_latency) {
+        m_latency = static_cast<hal::byte>(measured);
+        m_clean_wakeups = 0;
+      } else if (++m_clean_wakeups >= m_settings.decay_interval) {
+        m_clean_wakeups = 0;
+        if (m_latency > 0) {
+          m_latency--;
+        }
+      }
+    }
+
+    m_watermark = compute_watermark();
+    return m_watermark;
+  }
+
+private:
+  hal::byte compute_watermark() const
+  {
+    auto const reserved = std::size_t{ m_latency } + m_settings.margin;
+    if (reserved >= max_watermark) {
+      return 0;
+    }
+    return static_cast<hal::byte>(max_watermark - reserved);
+  }
+
+  settings m_settings;
+  hal::byte m_latency;
+  hal::byte m_watermark = 0;
+  std::size_t m_clean_wakeups = 0;
+  std::size_t m_overruns = 0;
+};
+}  // namespace hal::stm_imu
@@ -0,0 +1,169 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/steady_clock.hpp>
+
+namespace hal::stm_imu {
+/**
+ * @brief Histogram of call latencies with fixed power of two buckets
+ *
+ * Bucket 0 counts calls that took less than 1us. Bucket N counts calls that
+ * took at least 2^(N-1)us and less than 2^N us. The last bucket also counts
+ * every call slower than that.
+ */
+class latency_histogram
+{
+public:
+  /**
+   * @brief The number of buckets in the histogram
+   */
+  static constexpr std::size_t bucket_count = 16;
+
+  /**
+   * @brief Counts a call that took p_microseconds
+   *
+   * @param p_microseconds - duration of the call
+   */
+  void record(std::uint64_t p_microseconds)
+  {
+    auto const bucket = std::min<std::size_t>(std::bit_width(p_microseconds),
+                                              bucket_count - 1);
+    m_buckets[bucket]++;
+    m_max = std::max(m_max, p_microseconds);
+  }
+
+  /**
+   * @brief Returns the count held by every bucket
+   */
+  [[nodiscard]] std::span<std::uint32_t const, bucket_count> buckets() const
+  {
+    return m_buckets;
+  }
+
+  /**
+   * @brief Returns the slowest call recorded in microseconds
+   */
+  [[nodiscard]] std::uint64_t max() const
+  {
+    return m_max;
+  }
+
+  /**
+   * @brief Returns the number of calls recorded
+   */
+  [[nodiscard]] std::uint32_t count() const
+  {
+    std::uint32_t total = 0;
+    for (auto const bucket : m_buckets) {
+      total += bucket;
+    }
+    return total;
+  }
+
+private:
+  std::array<std::uint32_t, bucket_count> m_buckets{};
+  std::uint64_t m_max = 0;
+};
+
+/**
+ * @brief Counters a driver updates while metrics are attached to it
+ *
+ * Counters are plain integers meant to be copied out and exported to
+ * telemetry. Drivers only update them from the calling task, never from
+ * their interrupt handlers, so copy them from that same task. Assign a
+ * default constructed bus_metrics to reset it.
+ */
+struct bus_metrics
+{
+  /**
+   * @brief Number of bus transactions, each I2C transaction or SPI chip select
+   * frame counts as one
+   */
+  std::uint32_t transactions = 0;
+  /**
+   * @brief Number of data bytes written and read, register addresses included
+   */
+  std::uint64_t bytes = 0;
+  /**
+   * @brief Number of times chip select was asserted, always 0 for I2C
+   */
+  std::uint32_t chip_selects = 0;
+  /**
+   * @brief Number of FIFO reads that found the FIFO full (OVRN_FIFO)
+   */
+  std::uint32_t fifo_overruns = 0;
+  /**
+   * @brief Latency of calls that read samples
+   */
+  latency_histogram read_latency{};
+  /**
+   * @brief Latency of calls that change the device configuration
+   */
+  latency_histogram configure_latency{};
+};
+
+/**
+ * @brief Records the time from construction to destruction in a histogram
+ *
+ * Does nothing if p_histogram is null, which keeps the cost of a detached
+ * driver down to a single comparison per call.
+ */
+class scoped_latency
+{
+public:
+  /**
+   * @brief Starts timing a call
+   *
+   * @param p_histogram - histogram to record into, null to disable timing
+   * @param p_clock - clock to time the call with, must not be null when
+   * p_histogram is not null
+   */
+  scoped_latency(latency_histogram* p_histogram, hal::steady_clock* p_clock)
+    : m_histogram(p_histogram)
+    , m_clock(p_clock)
+  {
+    if (m_histogram) {
+      m_start = m_clock->uptime();
+    }
+  }
+
+  scoped_latency(scoped_latency const&) = delete;
+  scoped_latency& operator=(scoped_latency const&) = delete;
+
+  ~scoped_latency()
+  {
+    if (m_histogram) {
+      auto const ticks = m_clock->uptime() - m_start;
+      auto const microseconds_per_tick = 1'000'000.0f / m_clock->frequency();
+      m_histogram->record(
+        static_cast<std::uint64_t>(static_cast<float>(ticks) *
+                                   microseconds_per_tick));
+    }
+  }
+
+private:
+  latency_histogram* m_histogram;
+  hal::steady_clock* m_clock;
+  std::uint64_t m_start = 0;
+};
+}  // namespace hal::stm_imu
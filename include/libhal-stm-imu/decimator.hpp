@@ -0,0 +1,410 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <span>
+
+#include <libhal/accelerometer.hpp>
+#include <libhal/error.hpp>
+
+#include "lis3dhtr_core.hpp"
+
+namespace hal::stm_imu {
+/**
+ * @brief Streaming decimator for raw LIS3DH samples
+ *
+ * A CIC filter decimates by CicFactor, then a polyphase FIR filter decimates
+ * by FirFactor while compensating the passband droop of the CIC filter. The
+ * output rate is the input rate divided by CicFactor * FirFactor, for
+ * example mode_9 at 1344Hz decimated by 9 * 3 gives 49.8Hz.
+ *
+ * The CIC filter runs on the integer samples with wrapping 32 bit arithmetic,
+ * which is exact as long as the filter's gain fits in the headroom above a 12
+ * bit sample. The FIR filter runs in Q15 fixed point when Output is
+ * raw_read_t, which suits MCUs without an FPU, or in float when Output is
+ * accelerometer::read_t, in which case samples are also converted to g's.
+ * Both filters have unity gain at DC, so a calibration given to
+ * configure_calibration() is applied to the converted outputs exactly as the
+ * driver applies it to single samples. Raw outputs are never calibrated,
+ * convert them with lis3dhtr::convert() and lis3dhtr::conversion_for().
+ *
+ * Nothing is allocated, the filter state lives in the object.
+ *
+ * @tparam CicFactor - decimation factor of the CIC filter
+ * @tparam FirFactor - decimation factor of the FIR filter
+ * @tparam Output - lis3dhtr::raw_read_t or accelerometer::read_t
+ * @tparam Taps - length of the FIR filter
+ * @tparam Stages - number of integrator and comb stages of the CIC filter
+ */
+template<std::size_t CicFactor,
+         std::size_t FirFactor,
+         typename Output = accelerometer::read_t,
+         std::size_t Taps = 12 * FirFactor,
+         std::size_t Stages = 3>
+  requires(std::same_as<Output, lis3dhtr::raw_read_t> ||
+           std::same_as<Output, accelerometer::read_t>)
+class decimator
+{
+public:
+  static_assert(CicFactor >= 1 && FirFactor >= 1 && Taps >= FirFactor);
+  static_assert(Stages >= 1);
+  static_assert(12 + Stages * std::bit_width(CicFactor - 1) <= 31,
+                "CIC gain does not fit above a 12 bit sample in 32 bits");
+
+  /**
+   * @brief The type of the decimated samples
+   */
+  using output_t = Output;
+
+  /**
+   * @brief The total decimation factor
+   */
+  static constexpr std::size_t factor = CicFactor * FirFactor;
+
+  /**
+   * @brief The number of outputs a block of p_inputs samples can produce
+   *
+   * @param p_inputs - number of samples in the block
+   * @return std::size_t - the size of an output buffer that never runs short
+   */
+  static constexpr std::size_t max_outputs(std::size_t p_inputs)
+  {
+    return (p_inputs + factor - 1) / factor;
+  }
+
+  /**
+   * @brief Designs the FIR filter for the decimation factors
+   *
+   * The desired response is the inverse of the CIC filter's response up to
+   * 80% of the output Nyquist frequency and zero above it. It is sampled on a
+   * fine grid, transformed to taps and shaped with a Blackman window, then
+   * scaled for unity gain at DC. With the default length the cascade is flat
+   * within 0.1dB up to 20% of the output rate, 6dB down at 40% and more than
+   * 50dB down from 60% on, where tones would alias into the passband.
+   *
+   * @return std::array<float, Taps> - the filter taps
+   */
+  static std::array<float, Taps> design_compensator()
+  {
+    constexpr std::size_t grid = 256;
+    constexpr auto pi = std::numbers::pi_v<float>;
+    constexpr auto passband = 0.4f / FirFactor;
+
+    std::array<float, Taps> taps{};
+    auto const center = static_cast<float>(Taps - 1) / 2.0f;
+
+    for (std::size_t k = 0; k < grid; k++) {
+      // frequency in cycles per CIC output sample, 0 to 0.5
+      auto const frequency = (static_cast<float>(k) + 0.5f) * 0.5f / grid;
+      if (frequency > passband) {
+        break;
+      }
+      auto const response = 1.0f / cic_response(frequency);
+      for (std::size_t n = 0; n < Taps; n++) {
+        auto const phase =
+          2.0f * pi * frequency * (static_cast<float>(n) - center);
+        taps[n] += response * std::cos(phase);
+      }
+    }
+
+    float sum = 0.0f;
+    for (std::size_t n = 0; n < Taps; n++) {
+      auto const x = 2.0f * pi * static_cast<float>(n) / (Taps - 1);
+      taps[n] *= 0.42f - 0.5f * std::cos(x) + 0.08f * std::cos(2.0f * x);
+      sum += taps[n];
+    }
+    for (auto& tap : taps) {
+      tap /= sum;
+    }
+    return taps;
+  }
+
+  /**
+   * @brief Constructs the decimator with the designed compensation filter
+   */
+  decimator()
+    : decimator(design_compensator())
+  {
+  }
+
+  /**
+   * @brief Constructs the decimator with caller provided FIR taps
+   *
+   * @param p_taps - FIR filter taps with unity gain at DC
+   */
+  explicit decimator(std::array<float, Taps> const& p_taps)
+  {
+    // fold the CIC filter's gain into the taps
+    constexpr auto cic_gain = ipow(CicFactor, Stages);
+    if constexpr (std::same_as<Output, lis3dhtr::raw_read_t>) {
+      for (std::size_t n = 0; n < Taps; n++) {
+        auto const scaled = p_taps[n] * static_cast<float>(fixed_scale) /
+                            static_cast<float>(cic_gain);
+        m_taps[n] = static_cast<std::int16_t>(
+          std::clamp(std::lround(scaled * 32768.0f), -32768L, 32767L));
+      }
+    } else {
+      for (std::size_t n = 0; n < Taps; n++) {
+        m_taps[n] = p_taps[n] / static_cast<float>(cic_gain);
+      }
+    }
+  }
+
+  /**
+   * @brief The number of outputs the next p_inputs samples will produce
+   *
+   * Unlike max_outputs(), this accounts for the samples already held by the
+   * filters.
+   *
+   * @param p_inputs - number of samples in the next block
+   * @return std::size_t - the number of outputs process() will write
+   */
+  [[nodiscard]] std::size_t pending_outputs(std::size_t p_inputs) const
+  {
+    return (m_fir_phase * CicFactor + m_cic_phase + p_inputs) / factor;
+  }
+
+  /**
+   * @brief Filters a block of samples, such as a FIFO burst, in one call
+   *
+   * Every input is consumed, so p_output must hold every output the block
+   * produces. max_outputs() of the input size is always enough.
+   *
+   * @param p_input - raw samples in the order they were acquired
+   * @param p_output - buffer for the decimated samples
+   * @return std::span<Output> - the portion of p_output that was filled
+   * @throws hal::argument_out_of_domain - when p_output is smaller than
+   * pending_outputs() of the input size. Nothing is consumed.
+   */
+  std::span<Output> process(std::span<lis3dhtr::raw_read_t const> p_input,
+                            std::span<Output> p_output)
+  {
+    if (p_output.size() < pending_outputs(p_input.size())) {
+      hal::safe_throw(hal::argument_out_of_domain(this));
+    }
+
+    std::size_t produced = 0;
+    for (auto const& sample : p_input) {
+      if (push(sample)) {
+        p_output[produced++] = output(sample);
+      }
+    }
+    return p_output.first(produced);
+  }
+
+  /**
+   * @brief Applies a calibration to every output converted to g's
+   *
+   * @param p_calibration - the model to apply, usually
+   * lis3dhtr_core::calibration() of the driver the samples come from. A
+   * default constructed model removes the calibration.
+   */
+  void configure_calibration(lis3dhtr::calibration_model const& p_calibration)
+    requires(std::same_as<Output, accelerometer::read_t>)
+  {
+    m_calibration = p_calibration;
+    m_conversion_resolution = 0;
+  }
+
+  /**
+   * @brief Returns the filter to its initial state
+   */
+  void reset()
+  {
+    m_axes = {};
+    m_cic_phase = 0;
+    m_fir_phase = 0;
+    m_position = 0;
+  }
+
+private:
+  using accumulator_t =
+    std::conditional_t<std::same_as<Output, lis3dhtr::raw_read_t>,
+                       std::int32_t,
+                       float>;
+  using tap_t = std::conditional_t<std::same_as<Output, lis3dhtr::raw_read_t>,
+                                   std::int16_t,
+                                   float>;
+
+  static constexpr std::uint64_t ipow(std::uint64_t p_base, std::size_t p_exp)
+  {
+    std::uint64_t result = 1;
+    for (std::size_t i = 0; i < p_exp; i++) {
+      result *= p_base;
+    }
+    return result;
+  }
+
+  /// power of two that lifts the Q15 taps after the CIC gain is folded in
+  static constexpr std::int64_t fixed_scale =
+    std::int64_t{ 1 } << (std::bit_width(ipow(CicFactor, Stages)) - 1);
+
+  /// magnitude response of the CIC filter, normalized to unity at DC
+  static float cic_response(float p_frequency)
+  {
+    constexpr auto pi = std::numbers::pi_v<float>;
+    auto const numerator = std::sin(pi * p_frequency);
+    auto const denominator =
+      CicFactor * std::sin(pi * p_frequency / CicFactor);
+    return std::pow(std::abs(numerator / denominator),
+                    static_cast<float>(Stages));
+  }
+
+  /// filter state of one axis
+  struct axis_state
+  {
+    std::array<std::uint32_t, Stages> integrators{};
+    std::array<std::uint32_t, Stages> combs{};
+    /// every value is stored twice so a window of Taps values is contiguous
+    std::array<accumulator_t, 2 * Taps> line{};
+    accumulator_t result{};
+  };
+
+  /**
+   * @brief Feeds one sample through the filters
+   *
+   * @return true - an output sample is ready in the axis results
+   */
+  bool push(lis3dhtr::raw_read_t const& p_sample)
+  {
+    std::array<std::int16_t, 3> const values{ p_sample.x,
+                                              p_sample.y,
+                                              p_sample.z };
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      integrate(m_axes[axis], values[axis]);
+    }
+
+    if (++m_cic_phase < CicFactor) {
+      return false;
+    }
+    m_cic_phase = 0;
+
+    // the CIC output enters the FIR delay line, the FIR output is only
+    // computed for the samples that survive decimation, which is the
+    // polyphase form of the filter
+    for (auto& axis : m_axes) {
+      auto const value = comb(axis);
+      axis.line[m_position] = value;
+      axis.line[m_position + Taps] = value;
+    }
+    m_position = m_position == 0 ? Taps - 1 : m_position - 1;
+
+    if (++m_fir_phase < FirFactor) {
+      return false;
+    }
+    m_fir_phase = 0;
+
+    for (auto& axis : m_axes) {
+      auto const window = std::span(axis.line).subspan(m_position + 1);
+      axis.result = convolve(window.template first<Taps>());
+    }
+    return true;
+  }
+
+  static void integrate(axis_state& p_axis, std::int16_t p_value)
+  {
+    auto carry = static_cast<std::uint32_t>(p_value);
+    for (auto& integrator : p_axis.integrators) {
+      integrator += carry;
+      carry = integrator;
+    }
+  }
+
+  static accumulator_t comb(axis_state& p_axis)
+  {
+    auto value = p_axis.integrators.back();
+    for (auto& delay : p_axis.combs) {
+      auto const previous = delay;
+      delay = value;
+      value -= previous;
+    }
+    // the true CIC output fits in 32 bits, so the wrapped difference is exact
+    return static_cast<accumulator_t>(static_cast<std::int32_t>(value));
+  }
+
+  accumulator_t convolve(std::span<accumulator_t const, Taps> p_window) const
+  {
+    if constexpr (std::same_as<Output, lis3dhtr::raw_read_t>) {
+      std::int64_t sum = 0;
+      for (std::size_t n = 0; n < Taps; n++) {
+        sum += std::int64_t{ m_taps[n] } * p_window[n];
+      }
+      // round to nearest while removing the Q15 and fold scaling
+      constexpr auto shift = std::bit_width(std::uint64_t(fixed_scale)) + 14;
+      sum += std::int64_t{ 1 } << (shift - 1);
+      return static_cast<accumulator_t>(sum >> shift);
+    } else {
+      float sum = 0.0f;
+      for (std::size_t n = 0; n < Taps; n++) {
+        sum += m_taps[n] * p_window[n];
+      }
+      return sum;
+    }
+  }
+
+  Output output(lis3dhtr::raw_read_t const& p_sample)
+  {
+    if constexpr (std::same_as<Output, lis3dhtr::raw_read_t>) {
+      auto const clamp = [](std::int32_t p_value) {
+        return static_cast<std::int16_t>(
+          std::clamp<std::int32_t>(p_value, INT16_MIN, INT16_MAX));
+      };
+      return lis3dhtr::raw_read_t{
+        .x = clamp(m_axes[0].result),
+        .y = clamp(m_axes[1].result),
+        .z = clamp(m_axes[2].result),
+        .full_scale = p_sample.full_scale,
+        .resolution = p_sample.resolution,
+      };
+    } else {
+      // refold the calibration only when the sensitivity changes
+      if (p_sample.full_scale != m_conversion_full_scale ||
+          p_sample.resolution != m_conversion_resolution) {
+        m_conversion_full_scale = p_sample.full_scale;
+        m_conversion_resolution = p_sample.resolution;
+        m_conversion = lis3dhtr::conversion_for(
+          m_calibration, p_sample.full_scale, p_sample.resolution);
+      }
+      return lis3dhtr::convert(
+        std::array{ m_axes[0].result, m_axes[1].result, m_axes[2].result },
+        m_conversion);
+    }
+  }
+
+  /// state only used when Output is accelerometer::read_t
+  lis3dhtr::calibration_model m_calibration{};
+  /// m_calibration folded with the sensitivity of the last output
+  lis3dhtr::conversion m_conversion{};
+  lis3dhtr::max_acceleration m_conversion_full_scale =
+    lis3dhtr::max_acceleration::g2;
+  /// 0 until the first output, which forces the first fold
+  hal::byte m_conversion_resolution = 0;
+
+  std::array<tap_t, Taps> m_taps{};
+  std::array<axis_state, 3> m_axes{};
+  std::size_t m_cic_phase = 0;
+  std::size_t m_fir_phase = 0;
+  /// slot of the delay line the next CIC output is written to
+  std::size_t m_position = Taps - 1;
+};
+}  // namespace hal::stm_imu
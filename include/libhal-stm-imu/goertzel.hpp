@@ -0,0 +1,408 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+#include <libhal/units.hpp>
+
+#include "lis3dhtr_core.hpp"
+#include "sample_rate_estimator.hpp"
+#include "vibration_spectrum.hpp"
+
+namespace hal::stm_imu {
+/**
+ * @brief Returns the Goertzel bin nearest to a frequency
+ *
+ * Usable as a template argument of goertzel when the data rate is known at
+ * compile time, see lis3dhtr::output_data_rate(). That is the nominal data
+ * rate, and the device's oscillator is only accurate to a few percent. If
+ * the true rate is off by a fraction e, a tone at the nominal frequency of
+ * bin k lands k * e bins away from it, and its amplitude reads low by the
+ * bin's rectangular window response: 2% low at a tenth of a bin, 17% low
+ * at a third and 36% low at half a bin. Keep k * e below 0.1, or measure
+ * the true rate with sample_rate_estimator and use goertzel::frequency()
+ * with the estimator to know which frequency each bin actually measures.
+ *
+ * @param p_frequency - frequency of interest
+ * @param p_sample_rate - output data rate of the samples
+ * @param p_length - samples per block
+ * @return std::size_t - the bin index
+ */
+constexpr std::size_t goertzel_bin(hal::hertz p_frequency,
+                                   hal::hertz p_sample_rate,
+                                   std::size_t p_length)
+{
+  auto const position = p_frequency * p_length / p_sample_rate;
+  return position <= 0.0f ? 0 : static_cast<std::size_t>(position + 0.5f);
+}
+
+/**
+ * @brief Tracks the amplitude of a few frequencies on every axis
+ *
+ * Each bin runs a Goertzel filter that is updated with every sample, and
+ * after Length samples the amplitude of each bin is computed and the filters
+ * start over. A bin k measures the frequency k * ODR / Length, the same
+ * frequency as bin k of a Length point FFT, for 2 multiplications per bin
+ * and axis per sample instead of a full transform.
+ *
+ * With float samples the filters run in single precision. With std::int16_t
+ * samples they run in fixed point for MCUs without an FPU: the coefficients
+ * are 2 cos(w) in Q30, the filter state is 32 bit and each update costs one
+ * 64 bit multiply. A bin tunes to 2 - 2 cos(w), close to w * w, which at
+ * bin 1 of a 1024 sample block is only 3.8e-5, so a coarser coefficient
+ * would move the low bins off their frequency. Samples are shifted up into
+ * the headroom the state does not need, which keeps rounding errors well
+ * below a digit, and blocks are limited to 1024 samples so a 12 bit sample
+ * can never overflow the state. Only the amplitudes at the end of a block
+ * use floats.
+ *
+ * The amplitudes are in g's, using the sensitivity of the samples in the
+ * block and the calibration given to configure_calibration(). The filters
+ * are linear, so the calibration is applied once per block: the gain matrix
+ * combines the complex bins of the three axes and the offset lands in the
+ * DC bin. A change of full scale or resolution starts the block over. Use
+ * the goertzel and goertzel_fixed aliases rather than this class.
+ *
+ * @tparam Sample - float or std::int16_t (fixed point)
+ * @tparam Length - samples per block, the bin spacing is ODR / Length
+ * @tparam Bins - bin indices, at most Length / 2
+ */
+template<typename Sample, std::size_t Length, std::size_t... Bins>
+  requires(std::same_as<Sample, float> || std::same_as<Sample, std::int16_t>)
+class basic_goertzel
+{
+public:
+  static_assert(sizeof...(Bins) > 0);
+  static_assert(((Bins <= Length / 2) && ...),
+                "bins above Length / 2 alias onto lower bins");
+  static_assert(std::same_as<Sample, float> || Length <= 1024,
+                "fixed point blocks above 1024 samples overflow the state");
+
+  /**
+   * @brief The number of tracked bins
+   */
+  static constexpr std::size_t bin_count = sizeof...(Bins);
+
+  /**
+   * @brief Returns the frequency measured by a bin
+   *
+   * @param p_index - position of the bin in Bins
+   * @param p_sample_rate - output data rate of the samples
+   * @return hal::hertz - the frequency of the bin
+   */
+  static constexpr hal::hertz frequency(std::size_t p_index,
+                                        hal::hertz p_sample_rate)
+  {
+    return static_cast<float>(bins[p_index]) * p_sample_rate / Length;
+  }
+
+  /**
+   * @brief Returns the frequency a bin measures at the estimated true data
+   * rate
+   *
+   * @param p_index - position of the bin in Bins
+   * @param p_estimator - estimator fed with the drains the samples came from
+   * @return hal::hertz - the frequency of the bin
+   */
+  static hal::hertz frequency(std::size_t p_index,
+                              sample_rate_estimator const& p_estimator)
+  {
+    return frequency(p_index, p_estimator.sample_rate());
+  }
+
+  /**
+   * @brief Adds one sample
+   *
+   * @param p_sample - raw sample from the driver
+   * @return true - the sample completed a block and the amplitudes were
+   * updated
+   */
+  bool add(lis3dhtr::raw_read_t const& p_sample)
+  {
+    if (p_sample.full_scale != m_full_scale ||
+        p_sample.resolution != m_resolution) {
+      m_full_scale = p_sample.full_scale;
+      m_resolution = p_sample.resolution;
+      restart();
+    }
+
+    std::array<state_t, 3> const values{ to_state(p_sample.x),
+                                         to_state(p_sample.y),
+                                         to_state(p_sample.z) };
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      auto& state = m_state[axis];
+      for (std::size_t i = 0; i < bin_count; i++) {
+        if (bins[i] == 0) {
+          // the DC bin is the plain sum, as a resonator its state grows with
+          // the square of the block and floats lose the digits
+          state.s1[i] += values[axis];
+          continue;
+        }
+        auto const next =
+          step(values[axis], coefficients[i], state.s1[i], state.s2[i]);
+        state.s2[i] = state.s1[i];
+        state.s1[i] = next;
+      }
+    }
+
+    if (++m_filled < Length) {
+      return false;
+    }
+    finish_block();
+    restart();
+    return true;
+  }
+
+  /**
+   * @brief Adds a block of samples, such as a FIFO burst
+   *
+   * @param p_samples - raw samples in the order they were acquired
+   * @return true - at least one block completed and the amplitudes were
+   * updated
+   */
+  bool add(std::span<lis3dhtr::raw_read_t const> p_samples)
+  {
+    bool updated = false;
+    for (auto const& sample : p_samples) {
+      updated |= add(sample);
+    }
+    return updated;
+  }
+
+  /**
+   * @brief Returns the amplitudes of the last completed block
+   *
+   * A sinusoid on a bin's frequency shows its peak amplitude in that bin.
+   *
+   * @param p_axis - 0 for x, 1 for y and 2 for z
+   * @return std::span<float const, bin_count> - amplitudes in g's in the
+   * order of Bins
+   */
+  [[nodiscard]] std::span<float const, bin_count> amplitudes(
+    std::size_t p_axis) const
+  {
+    return m_amplitudes[p_axis];
+  }
+
+  /**
+   * @brief Applies a calibration to the amplitudes of the following blocks
+   *
+   * @param p_calibration - the model to apply, usually
+   * lis3dhtr_core::calibration() of the driver the samples come from. A
+   * default constructed model removes the calibration.
+   */
+  void configure_calibration(lis3dhtr::calibration_model const& p_calibration)
+  {
+    m_calibration = p_calibration;
+  }
+
+  /**
+   * @return std::uint32_t - the number of blocks completed
+   */
+  [[nodiscard]] std::uint32_t blocks() const
+  {
+    return m_blocks;
+  }
+
+private:
+  static constexpr bool fixed_point = std::same_as<Sample, std::int16_t>;
+  using state_t = std::conditional_t<fixed_point, std::int32_t, float>;
+
+  static constexpr std::array<std::size_t, bin_count> bins{ Bins... };
+
+  /// fixed point coefficients are 64 bit so that 2 cos(0) = 2 is exact in
+  /// Q30, the product with a 32 bit state still fits
+  using coefficient_t = std::conditional_t<fixed_point, std::int64_t, float>;
+
+  /// fraction bits of the fixed point coefficients
+  static constexpr int coefficient_bits = 30;
+
+  /// bits samples are shifted up by in fixed point, as many as the largest
+  /// possible state allows. A state is at most Length * (Length + 1) / 2
+  /// times the largest input, where each input is a full scale sample plus
+  /// half an LSB from rounding the product of the previous update.
+  static constexpr int input_shift = [] {
+    if constexpr (fixed_point) {
+      constexpr std::uint64_t gain = std::uint64_t{ Length } * (Length + 1) / 2;
+      // twice the largest state, in LSBs, stays below 2^32
+      constexpr auto fits = [](int p_shift) {
+        return gain * ((std::uint64_t{ 2048 } << (p_shift + 1)) + 1) <
+               (std::uint64_t{ 1 } << 32);
+      };
+      int shift = 0;
+      while (fits(shift + 1)) {
+        shift++;
+      }
+      return shift;
+    } else {
+      return 0;
+    }
+  }();
+
+  /// 2 cos(2 pi k / Length) for every bin
+  static constexpr std::array<coefficient_t, bin_count> coefficients = [] {
+    std::array<coefficient_t, bin_count> table{};
+    for (std::size_t i = 0; i < bin_count; i++) {
+      auto const value = 2.0 * detail::unit_root(bins[i], Length).cos;
+      if constexpr (fixed_point) {
+        auto const scaled = value * static_cast<double>(coefficient_t{ 1 }
+                                                        << coefficient_bits);
+        table[i] = static_cast<coefficient_t>(scaled < 0.0 ? scaled - 0.5
+                                                           : scaled + 0.5);
+      } else {
+        table[i] = static_cast<float>(value);
+      }
+    }
+    return table;
+  }();
+
+  /// sin(2 pi k / Length) for every bin
+  static constexpr std::array<float, bin_count> sines = [] {
+    std::array<float, bin_count> table{};
+    for (std::size_t i = 0; i < bin_count; i++) {
+      table[i] = static_cast<float>(detail::unit_root(bins[i], Length).sin);
+    }
+    return table;
+  }();
+
+  static state_t to_state(std::int16_t p_value)
+  {
+    if constexpr (fixed_point) {
+      return state_t{ p_value } * (state_t{ 1 } << input_shift);
+    } else {
+      return static_cast<float>(p_value);
+    }
+  }
+
+  static state_t step(state_t p_value,
+                      coefficient_t p_coefficient,
+                      state_t p_s1,
+                      state_t p_s2)
+  {
+    if constexpr (fixed_point) {
+      constexpr std::int64_t half = std::int64_t{ 1 }
+                                    << (coefficient_bits - 1);
+      auto const product = (p_coefficient * p_s1 + half) >> coefficient_bits;
+      // the state itself always fits, see input_shift
+      return static_cast<state_t>(p_value + product - p_s2);
+    } else {
+      return p_value + p_coefficient * p_s1 - p_s2;
+    }
+  }
+
+  struct axis_state
+  {
+    std::array<state_t, bin_count> s1{};
+    std::array<state_t, bin_count> s2{};
+  };
+
+  void restart()
+  {
+    m_state = {};
+    m_filled = 0;
+  }
+
+  void finish_block()
+  {
+    auto const conversion =
+      lis3dhtr::conversion_for(m_calibration, m_full_scale, m_resolution);
+
+    // the bins in digits, s1 - e^(-jw) s2
+    std::array<std::array<std::complex<float>, bin_count>, 3> values{};
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      auto const& state = m_state[axis];
+      for (std::size_t i = 0; i < bin_count; i++) {
+        // the real part is taken before it is squared as s1 and s2 nearly
+        // cancel at low frequencies
+        float real = 0.0f;
+        float imaginary = 0.0f;
+        if constexpr (fixed_point) {
+          auto const twice_real =
+            (std::int64_t{ state.s1[i] } << (coefficient_bits + 1)) -
+            coefficients[i] * state.s2[i];
+          real = std::ldexp(static_cast<float>(twice_real),
+                            -(coefficient_bits + 1 + input_shift));
+          imaginary =
+            sines[i] *
+            std::ldexp(static_cast<float>(state.s2[i]), -input_shift);
+        } else {
+          real = state.s1[i] - 0.5f * coefficients[i] * state.s2[i];
+          imaginary = sines[i] * state.s2[i];
+        }
+        values[axis][i] = { real, imaginary };
+      }
+    }
+
+    for (std::size_t row = 0; row < 3; row++) {
+      auto const& gain = conversion.gain[row];
+      for (std::size_t i = 0; i < bin_count; i++) {
+        std::complex<float> value{};
+        if (conversion.cross_axis) {
+          for (std::size_t column = 0; column < 3; column++) {
+            value += gain[column] * values[column][i];
+          }
+        } else {
+          value = gain[row] * values[row][i];
+        }
+        value /= static_cast<float>(Length);
+        if (bins[i] == 0) {
+          value += conversion.offset[row];
+        }
+        // single sided, DC and Nyquist are not doubled
+        auto const sides = (bins[i] == 0 || 2 * bins[i] == Length) ? 1.0f
+                                                                   : 2.0f;
+        m_amplitudes[row][i] =
+          std::sqrt(value.real() * value.real() + value.imag() * value.imag()) *
+          sides;
+      }
+    }
+    m_blocks++;
+  }
+
+  std::array<axis_state, 3> m_state{};
+  std::array<std::array<float, bin_count>, 3> m_amplitudes{};
+  std::size_t m_filled = 0;
+  std::uint32_t m_blocks = 0;
+  lis3dhtr::max_acceleration m_full_scale = lis3dhtr::max_acceleration::g2;
+  hal::byte m_resolution = 0;
+  lis3dhtr::calibration_model m_calibration{};
+};
+
+/**
+ * @brief Goertzel tone tracker running in single precision floats
+ */
+template<std::size_t Length, std::size_t... Bins>
+using goertzel = basic_goertzel<float, Length, Bins...>;
+
+/**
+ * @brief Goertzel tone tracker running in fixed point, for MCUs without an
+ * FPU
+ *
+ * The samples stay in raw digits and the coefficients are Q30, see
+ * basic_goertzel.
+ */
+template<std::size_t Length, std::size_t... Bins>
+using goertzel_fixed = basic_goertzel<std::int16_t, Length, Bins...>;
+}  // namespace hal::stm_imu
@@ -0,0 +1,1758 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal-util/bit.hpp>
+#include <libhal/accelerometer.hpp>
+#include <libhal/error.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "adaptive_watermark.hpp"
+#include "bus_metrics.hpp"
+#include "sample_rate_estimator.hpp"
+#include "spsc_ring_buffer.hpp"
+
+namespace hal::stm_imu {
+/**
+ * @brief Types, register map and conversions shared by every LIS3DH driver
+ */
+class lis3dhtr
+{
+public:
+  /**
+   * @brief max_acceleration is the maxium g's that the device will read
+   * NOTE: the higher the max gravity you select, the lower your resolution is
+   */
+  enum class max_acceleration : hal::byte
+  {
+    /**
+     * @brief 2x the average earth gravity, acceleration
+     */
+    g2 = 0x00,
+    /**
+     * @brief 4x the average earth gravity, acceleration
+     */
+    g4 = 0x01,
+    /**
+     * @brief 8x the average earth gravity, acceleration
+     */
+    g8 = 0x02,
+    /**
+     * @brief 16x the average earth gravity, acceleration
+     */
+    g16 = 0x03,
+  };
+
+  /**
+   * @brief data_rate_config are the different data rates that the imu can be
+   * programmed to output data at in the different modes
+   */
+  enum class data_rate_config : hal::byte
+  {
+    /**
+     * @brief 0Hz (this is the power down command)
+     */
+    mode_0 = 0b0000,
+    /**
+     * @brief 1Hz
+     */
+    mode_1 = 0b0001,
+    /**
+     * @brief 10Hz
+     */
+    mode_2 = 0b0010,
+    /**
+     * @brief 25Hz
+     */
+    mode_3 = 0b0011,
+    /**
+     * @brief 50Hz
+     */
+    mode_4 = 0b0100,
+    /**
+     * @brief 100Hz
+     */
+    mode_5 = 0b0101,
+    /**
+     * @brief 200Hz
+     */
+    mode_6 = 0b0110,
+    /**
+     * @brief 400Hz
+     */
+    mode_7 = 0b0111,
+    /**
+     * @brief just low power mode is configured in this one to 1.6kHz
+     * this is also the default mode set by power_on
+     *
+     * Only valid when operating_mode::low_power is selected.
+     */
+    mode_8 = 0b1000,
+    /**
+     * @brief High resolution = normal = 1.344kHz; low power mode = 5.376kHz
+     */
+    mode_9 = 0b1001,
+  };
+
+  /**
+   * @brief operating_mode are the different power modes of the device, which
+   * trade resolution for power consumption and maximum data rate. The value
+   * of each mode is its resolution in bits.
+   */
+  enum class operating_mode : hal::byte
+  {
+    /**
+     * @brief 8-bit samples, unlocks the 1.6kHz and 5.376kHz data rates
+     * (LPen = 1, HR = 0)
+     */
+    low_power = 8,
+    /**
+     * @brief 10-bit samples (LPen = 0, HR = 0)
+     */
+    normal = 10,
+    /**
+     * @brief 12-bit samples, limited to 1.344kHz (LPen = 0, HR = 1)
+     */
+    high_resolution = 12,
+  };
+
+  /**
+   * @brief fifo_mode are the different ways the 32 sample FIFO can collect
+   * samples
+   */
+  enum class fifo_mode : hal::byte
+  {
+    /**
+     * @brief FIFO is disabled, only the latest sample is held by the device
+     */
+    bypass = 0b00,
+    /**
+     * @brief FIFO collects samples until it is full then stops collecting
+     */
+    fifo = 0b01,
+    /**
+     * @brief FIFO collects samples continuously, the oldest sample is dropped
+     * when it is full
+     */
+    stream = 0b10,
+    /**
+     * @brief FIFO acts in stream mode until an interrupt event occurs then
+     * switches to FIFO mode
+     */
+    stream_to_fifo = 0b11,
+  };
+
+  /**
+   * @brief The number of samples the device FIFO can hold
+   */
+  static constexpr std::size_t fifo_depth = 32;
+
+  /**
+   * @brief settings describes the complete configuration of the device and is
+   * written to the device in a single burst by configure()
+   */
+  struct settings
+  {
+    /**
+     * @brief The frequency that new data can be read from the device
+     */
+    data_rate_config data_rate = data_rate_config::mode_7;
+    /**
+     * @brief The full scale setting for the imu
+     */
+    max_acceleration full_scale = max_acceleration::g2;
+    /**
+     * @brief The resolution and power mode of the device
+     */
+    operating_mode mode = operating_mode::normal;
+    /**
+     * @brief How the FIFO collects samples
+     */
+    fifo_mode fifo = fifo_mode::bypass;
+  };
+
+  /**
+   * @brief Selects the constructor that writes the configuration without
+   * verifying the device first
+   */
+  struct fast_start_t
+  {
+    explicit fast_start_t() = default;
+  };
+
+  /**
+   * @brief Tag passed to constructors to skip WHO_AM_I verification
+   */
+  static constexpr fast_start_t fast_start{};
+
+  /**
+   * @brief Selects the constructor that adopts the configuration the device
+   * already holds
+   */
+  struct warm_restart_t
+  {
+    explicit warm_restart_t() = default;
+  };
+
+  /**
+   * @brief Tag passed to constructors to resume a device configured before
+   * the MCU was reset
+   */
+  static constexpr warm_restart_t warm_restart{};
+
+  /**
+   * @brief raw_read_t is a sample in the device's native integer counts
+   */
+  struct raw_read_t
+  {
+    /**
+     * @brief x axis acceleration in digits
+     */
+    std::int16_t x;
+    /**
+     * @brief y axis acceleration in digits
+     */
+    std::int16_t y;
+    /**
+     * @brief z axis acceleration in digits
+     */
+    std::int16_t z;
+    /**
+     * @brief The full scale setting the sample was captured with
+     */
+    max_acceleration full_scale;
+    /**
+     * @brief The number of significant bits of each axis
+     */
+    hal::byte resolution;
+  };
+
+  /**
+   * @brief status_read_t is a sample along with the data status flags that
+   * were read alongside it
+   */
+  struct status_read_t
+  {
+    /**
+     * @brief The acceleration held by the output registers
+     */
+    accelerometer::read_t acceleration;
+    /**
+     * @brief true if a new sample became available since the output
+     * registers were last read (ZYXDA)
+     */
+    bool new_data;
+    /**
+     * @brief true if a new sample overwrote one that had not been read yet
+     * (ZYXOR)
+     */
+    bool overrun;
+  };
+
+  /**
+   * @brief timestamped_read_t is a raw sample along with the time the device
+   * acquired it
+   */
+  struct timestamped_read_t
+  {
+    /**
+     * @brief The sample in digits
+     */
+    raw_read_t sample;
+    /**
+     * @brief Uptime of the hal::steady_clock used to read the sample at the
+     * moment the device acquired it, in ticks of that clock
+     */
+    std::uint64_t ticks;
+  };
+
+  /**
+   * @brief Corrections for the offset, gain and axis misalignment of a
+   * particular device
+   *
+   * A reading r in g's is corrected to cross_axis * (scale * (r - bias)),
+   * with scale applied per axis. The defaults leave readings unchanged. See
+   * six_position_calibration to measure a model.
+   */
+  struct calibration_model
+  {
+    /**
+     * @brief Reading of each axis in g's when it measures no acceleration
+     */
+    std::array<float, 3> bias{ 0.0f, 0.0f, 0.0f };
+    /**
+     * @brief Gain correction of each axis
+     */
+    std::array<float, 3> scale{ 1.0f, 1.0f, 1.0f };
+    /**
+     * @brief Row major matrix that removes the coupling between axes, applied
+     * after bias and scale. Leave as identity unless the coupling matters,
+     * since any other matrix costs 9 multiplies per sample instead of 3.
+     */
+    std::array<std::array<float, 3>, 3> cross_axis{ {
+      { 1.0f, 0.0f, 0.0f },
+      { 0.0f, 1.0f, 0.0f },
+      { 0.0f, 0.0f, 1.0f },
+    } };
+  };
+
+  /**
+   * @brief Returns the nominal output data rate of a configuration
+   *
+   * @param p_data_rate - the data rate setting
+   * @param p_mode - the operating mode, which selects the rate of mode_9
+   * @return hal::hertz - samples per second, 0 when powered down
+   */
+  static constexpr hal::hertz output_data_rate(data_rate_config p_data_rate,
+                                               operating_mode p_mode)
+  {
+    constexpr std::array<hal::hertz, 9> rates{
+      0.0f, 1.0f, 10.0f, 25.0f, 50.0f, 100.0f, 200.0f, 400.0f, 1620.0f
+    };
+    if (p_data_rate == data_rate_config::mode_9) {
+      return p_mode == operating_mode::low_power ? 5376.0f : 1344.0f;
+    }
+    auto const index = static_cast<std::size_t>(p_data_rate);
+    return index < rates.size() ? rates[index] : 0.0f;
+  }
+
+  /**
+   * @brief Returns the size of one digit of a raw sample in milli-g
+   *
+   * Raw samples multiplied by this value are in milli-g, which allows
+   * thresholds and logging to stay in the integer domain.
+   *
+   * @param p_full_scale - the full scale the sample was captured with
+   * @param p_resolution - the resolution of the sample, 8, 10 or 12 bits
+   * @return std::uint16_t - sensitivity in milli-g per digit
+   */
+  static constexpr std::uint16_t milli_g_per_digit(
+    max_acceleration p_full_scale,
+    hal::byte p_resolution)
+  {
+    auto const full_scale = static_cast<std::size_t>(p_full_scale);
+    return static_cast<std::uint16_t>(high_resolution_sensitivity[full_scale]
+                                      << (high_resolution - p_resolution));
+  }
+
+  /**
+   * @brief Converts a raw sample to acceleration in g's
+   *
+   * @param p_raw - the raw sample to convert
+   * @return accelerometer::read_t - acceleration in g's
+   */
+  static accelerometer::read_t convert(raw_read_t const& p_raw)
+  {
+    auto const g_per_digit =
+      milli_g_per_digit(p_raw.full_scale, p_raw.resolution) / 1000.0f;
+
+    return scale(p_raw, g_per_digit);
+  }
+
+  /**
+   * @brief Converts digits to calibrated g's, see conversion_for()
+   */
+  struct conversion
+  {
+    /// g's per digit, row major
+    std::array<std::array<float, 3>, 3> gain{};
+    /// g's added after the gain
+    std::array<float, 3> offset{};
+    /// gain has non-zero elements off the diagonal
+    bool cross_axis = false;
+  };
+
+  /**
+   * @brief Folds a calibration and the sensitivity of a full scale and
+   * resolution into a conversion
+   *
+   * Expanding cross_axis * (scale * (digits * sensitivity - bias)) gives a
+   * gain per digit and an offset, so the calibration adds no work per sample
+   * unless the cross axis matrix couples the axes. Consumers of raw samples
+   * use this to report calibrated g's, see lis3dhtr_core::calibration().
+   *
+   * @param p_calibration - the calibration to apply
+   * @param p_full_scale - the full scale of the samples
+   * @param p_resolution - the resolution of the samples, 8, 10 or 12 bits
+   * @return conversion - the folded coefficients
+   */
+  static constexpr conversion conversion_for(
+    calibration_model const& p_calibration,
+    max_acceleration p_full_scale,
+    hal::byte p_resolution)
+  {
+    auto const sensitivity =
+      milli_g_per_digit(p_full_scale, p_resolution) / 1000.0f;
+
+    conversion result{};
+    for (std::size_t row = 0; row < 3; row++) {
+      for (std::size_t column = 0; column < 3; column++) {
+        auto const coupling = p_calibration.cross_axis[row][column];
+        auto const gain = coupling * p_calibration.scale[column];
+        result.gain[row][column] = gain * sensitivity;
+        result.offset[row] -= gain * p_calibration.bias[column];
+        if (row != column && coupling != 0.0f) {
+          result.cross_axis = true;
+        }
+      }
+    }
+    return result;
+  }
+
+  /**
+   * @brief Converts a raw sample to calibrated g's
+   *
+   * @param p_raw - the raw sample to convert
+   * @param p_conversion - coefficients from conversion_for() matching the
+   * full scale and resolution of the sample
+   * @return accelerometer::read_t - acceleration in g's
+   */
+  static accelerometer::read_t convert(raw_read_t const& p_raw,
+                                       conversion const& p_conversion)
+  {
+    return convert(std::array{ static_cast<float>(p_raw.x),
+                               static_cast<float>(p_raw.y),
+                               static_cast<float>(p_raw.z) },
+                   p_conversion);
+  }
+
+  /**
+   * @brief Converts digits to calibrated g's
+   *
+   * @param p_digits - x, y and z in digits, such as filtered or averaged
+   * samples
+   * @param p_conversion - coefficients from conversion_for() matching the
+   * full scale and resolution of the digits
+   * @return accelerometer::read_t - acceleration in g's
+   */
+  static accelerometer::read_t convert(std::array<float, 3> const& p_digits,
+                                       conversion const& p_conversion)
+  {
+    auto const& gain = p_conversion.gain;
+    auto const& offset = p_conversion.offset;
+    auto const& digits = p_digits;
+
+    if (p_conversion.cross_axis) {
+      auto const row = [&](std::size_t p_row) {
+        return gain[p_row][0] * digits[0] + gain[p_row][1] * digits[1] +
+               gain[p_row][2] * digits[2] + offset[p_row];
+      };
+      return accelerometer::read_t{ .x = row(0), .y = row(1), .z = row(2) };
+    }
+
+    return accelerometer::read_t{
+      .x = gain[0][0] * digits[0] + offset[0],
+      .y = gain[1][1] * digits[1] + offset[1],
+      .z = gain[2][2] * digits[2] + offset[2],
+    };
+  }
+
+protected:
+  /// Device identification register
+  static constexpr hal::byte who_am_i_register = 0x0F;
+  /// the expected value of WHO_AM_I as read from the data sheet
+  static constexpr hal::byte expected_who_am_i = 0x33;
+  /// Used to set data rate selection, power mode, and z, y, and x axis
+  /// toggling
+  static constexpr hal::byte ctrl_reg1 = 0x20;
+  /// Used to configure the high pass filter
+  static constexpr hal::byte ctrl_reg2 = 0x21;
+  /// Used to route interrupts to the INT1 pin
+  static constexpr hal::byte ctrl_reg3 = 0x22;
+  /// Used to set the full scale, resolution and spi wire mode
+  static constexpr hal::byte ctrl_reg4 = 0x23;
+  /// Used to reboot memory and toggle fifo
+  static constexpr hal::byte ctrl_reg5 = 0x24;
+  /// Used to route interrupts to the INT2 pin
+  static constexpr hal::byte ctrl_reg6 = 0x25;
+  /// Holds the new data and data overrun flags, directly precedes OUT_X_L
+  static constexpr hal::byte status_reg = 0x27;
+  /// low bits of x accelerations data, the first of the output registers
+  static constexpr hal::byte out_x_l = 0x28;
+  /// Used to change fifo modes
+  static constexpr hal::byte fifo_ctrl_reg = 0x2E;
+  /// Holds the fifo watermark, overrun, empty flags and the stored sample
+  /// count
+  static constexpr hal::byte fifo_src_reg = 0x2F;
+  /// The first register held in the driver's register cache
+  static constexpr hal::byte cached_register_begin = ctrl_reg1;
+  /// The last register held in the driver's register cache
+  static constexpr hal::byte cached_register_end = fifo_ctrl_reg;
+  /// number of bytes that make up a single xyz sample
+  static constexpr std::size_t bytes_per_sample = 6;
+  /// number of significant bits per axis in high resolution mode
+  static constexpr hal::byte high_resolution = 12;
+  /// sensitivity in milli-g per digit in high resolution mode, indexed by the
+  /// full scale code. Each bit of resolution below 12 doubles the sensitivity.
+  static constexpr std::array<std::uint16_t, 4> high_resolution_sensitivity{
+    1, 2, 4, 12
+  };
+
+  static raw_read_t parse_raw(std::span<hal::byte const> p_data,
+                              hal::byte p_gscale,
+                              hal::byte p_resolution)
+  {
+    /* parsing data from accelerometer
+     all data is left justified which means the unused low bits are always 0,
+     so the low and high bytes are or'ed together and the result is shifted
+     right by the number of unused bits 0000'0000'0000'0000
+    */
+    constexpr auto read_h_bit_mask = hal::bit_mask::from<15, 8>();
+    auto const unused_bits = 16 - p_resolution;
+
+    auto const combine = [p_data](std::size_t p_axis) {
+      auto value = static_cast<std::uint16_t>(p_data[p_axis * 2]);
+      hal::bit_modify(value).insert<read_h_bit_mask>(
+        static_cast<std::uint16_t>(p_data[p_axis * 2 + 1]));
+      return static_cast<std::int16_t>(value);
+    };
+
+    return raw_read_t{
+      .x = static_cast<std::int16_t>(combine(0) >> unused_bits),
+      .y = static_cast<std::int16_t>(combine(1) >> unused_bits),
+      .z = static_cast<std::int16_t>(combine(2) >> unused_bits),
+      .full_scale = static_cast<max_acceleration>(p_gscale),
+      .resolution = p_resolution,
+    };
+  }
+
+  static accelerometer::read_t scale(raw_read_t const& p_raw,
+                                     float p_g_per_digit)
+  {
+    return accelerometer::read_t{
+      .x = p_raw.x * p_g_per_digit,
+      .y = p_raw.y * p_g_per_digit,
+      .z = p_raw.z * p_g_per_digit,
+    };
+  }
+};
+
+/**
+ * @brief The bus specific half of a LIS3DH driver
+ *
+ * A transport turns a register address into the command byte that starts an
+ * auto-incrementing read or write, and performs a single bus transaction that
+ * writes p_data_out then reads p_data_in.
+ *
+ * A transport may also provide `hal::byte ctrl_reg4_bits() const`, returning
+ * CTRL_REG4 bits the bus needs set, such as SIM for 3-wire SPI. The core
+ * writes them before verifying the device and keeps them set afterwards. A
+ * transport that also provides `configure_spi_mode()` can have its wire mode
+ * changed at runtime through lis3dhtr_core::configure_spi_mode().
+ */
+template<typename T>
+concept lis3dhtr_transport =
+  requires(T& p_transport,
+           std::span<hal::byte const> p_data_out,
+           std::span<hal::byte> p_data_in,
+           hal::byte p_register) {
+    { T::read_command(p_register) } -> std::same_as<hal::byte>;
+    { T::write_command(p_register) } -> std::same_as<hal::byte>;
+    {
+      T::chip_selects_per_transaction
+    } -> std::convertible_to<std::uint32_t>;
+    p_transport.transaction(p_data_out, p_data_in);
+  };
+
+/**
+ * @brief Register level LIS3DH driver written once for every bus
+ *
+ * Every register operation of the device lives here. The transport only
+ * decides how command bytes are encoded and how a transaction is framed on
+ * the bus, so the compiler can inline it into each operation.
+ *
+ * @tparam Transport - a type satisfying lis3dhtr_transport
+ */
+template<lis3dhtr_transport Transport>
+class lis3dhtr_core : public lis3dhtr
+{
+public:
+  /**
+   * @brief Verifies the device then applies a complete device configuration
+   *
+   * After verifying the device, CTRL_REG1 through CTRL_REG6 are written in a
+   * single burst, followed by FIFO_CTRL_REG.
+   *
+   * @param p_transport - the bus the device is connected to
+   * @param p_settings - the configuration to apply to the device
+   *
+   * @throws hal::no_such_device - when ID register does not match
+   * the expected ID for the lis3dhtr device.
+   */
+  lis3dhtr_core(Transport p_transport, settings const& p_settings)
+    : m_transport(p_transport)
+  {
+    // the device may only answer once it is switched to the transport's bus
+    // mode, writes are understood in every mode
+    if (transport_ctrl_reg4() != 0) {
+      write_register(ctrl_reg4, transport_ctrl_reg4());
+    }
+    verify_device();
+    configure(p_settings);
+  }
+
+  /**
+   * @brief Applies a complete device configuration without verifying the
+   * device
+   *
+   * Only CTRL_REG1 through CTRL_REG6 are written in a single burst, followed
+   * by FIFO_CTRL_REG unless the FIFO is bypassed. A bypassed FIFO is disabled
+   * by FIFO_EN in CTRL_REG5, so a mode the device kept through an MCU reset
+   * has no effect, and every later write of FIFO_CTRL_REG writes the whole
+   * register. Nothing is read back, so with the FIFO bypassed, and outside of
+   * low power mode, the device is configured in a single transaction. Call
+   * device_present() or verify_device() later, for example from a health
+   * check, to confirm the device is the one expected.
+   *
+   * @param p_transport - the bus the device is connected to
+   * @param p_settings - the configuration to apply to the device
+   */
+  lis3dhtr_core(Transport p_transport,
+                settings const& p_settings,
+                fast_start_t)
+    : m_transport(p_transport)
+  {
+    write_configuration(p_settings);
+    if (p_settings.fifo != fifo_mode::bypass) {
+      write_fifo_mode(p_settings.fifo);
+    }
+  }
+
+  /**
+   * @brief Resumes a device that kept its configuration through an MCU reset
+   *
+   * Nothing is written to the device, so samples already in the FIFO are kept
+   * and the device keeps sampling while the driver starts. See
+   * adopt_configuration() for what is read. The device is not verified, call
+   * device_present() or verify_device() if it may have been replaced.
+   *
+   * @param p_transport - the bus the device is connected to
+   */
+  lis3dhtr_core(Transport p_transport, warm_restart_t)
+    : m_transport(p_transport)
+  {
+    adopt_configuration();
+  }
+
+  /**
+   * @brief verify's that the device exists on the bus
+   *
+   * @throws hal::no_such_device - when ID register does not match
+   */
+  void verify_device()
+  {
+    if (not device_present()) {
+      hal::safe_throw(hal::no_such_device(expected_who_am_i, this));
+    }
+  }
+
+  /**
+   * @brief Reads WHO_AM_I and reports if it matches the LIS3DH
+   *
+   * Unlike verify_device(), a mismatch is reported rather than thrown, which
+   * suits periodic health checks.
+   *
+   * @return true - the device answered with the expected ID
+   */
+  [[nodiscard]] bool device_present()
+  {
+    std::array<hal::byte, 1> who_am_i{};
+    read_registers(who_am_i_register, who_am_i);
+    return who_am_i[0] == expected_who_am_i;
+  }
+
+  /**
+   * @brief enables acceleration readings from the lis
+   *
+   */
+  void power_on()
+  {
+    configure_data_rates(data_rate_config::mode_7);
+  }
+
+  /**
+   * @brief Disables acceleration reading from the lis.
+   *
+   */
+  void power_off()
+  {
+    configure_data_rates(data_rate_config::mode_0);
+  }
+
+  /**
+   * @brief Configures the frequency that new data can be read from the device
+   *
+   * @param p_data_rate - the frequency that new data can be read from the
+   * device
+   */
+  void configure_data_rates(data_rate_config p_data_rate)
+  {
+    constexpr auto configure_reg_bit_mask = hal::bit_mask::from<7, 4>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto ctrl_reg1_data = cached_register(ctrl_reg1);
+    hal::bit_modify<hal::byte>(ctrl_reg1_data)
+      .insert<configure_reg_bit_mask>(static_cast<hal::byte>(p_data_rate));
+
+    write_register(ctrl_reg1, ctrl_reg1_data);
+  }
+
+  /**
+   * @brief Changes the gravity scale that the lis is reading. The larger the
+   * scale, the less precise the reading.
+   *
+   * @param p_gravity_code - Scales in powers of 2 up to 16.
+   */
+  void configure_full_scale(max_acceleration p_gravity_code)
+  {
+    constexpr auto configure_reg_bit_mask = hal::bit_mask::from<5, 4>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    m_gscale = static_cast<hal::byte>(p_gravity_code);
+    update_conversion();
+
+    auto ctrl_reg4_data = cached_register(ctrl_reg4);
+    hal::bit_modify<hal::byte>(ctrl_reg4_data)
+      .insert<configure_reg_bit_mask>(static_cast<hal::byte>(p_gravity_code));
+
+    write_register(ctrl_reg4, ctrl_reg4_data);
+  }
+
+  /**
+   * @brief Changes the resolution and power mode of the device
+   *
+   * LPen (CTRL_REG1) and HR (CTRL_REG4) must never be set together, so the
+   * bit being cleared is written first: CTRL_REG4 before CTRL_REG1 when
+   * entering low power mode, CTRL_REG1 before CTRL_REG4 otherwise. Registers
+   * that do not change are not written. Samples read afterwards are shifted
+   * and scaled for the new resolution.
+   *
+   * @param p_mode - the operating mode to use
+   */
+  void configure_operating_mode(operating_mode p_mode)
+  {
+    constexpr auto low_power_bit_mask = hal::bit_mask::from<3>();
+    constexpr auto high_resolution_bit_mask = hal::bit_mask::from<3>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto ctrl_reg1_data = cached_register(ctrl_reg1);
+    auto ctrl_reg4_data = cached_register(ctrl_reg4);
+    hal::bit_modify<hal::byte>(ctrl_reg1_data).clear<low_power_bit_mask>();
+    hal::bit_modify<hal::byte>(ctrl_reg4_data)
+      .clear<high_resolution_bit_mask>();
+
+    if (p_mode == operating_mode::low_power) {
+      hal::bit_modify<hal::byte>(ctrl_reg1_data).set<low_power_bit_mask>();
+    } else if (p_mode == operating_mode::high_resolution) {
+      hal::bit_modify<hal::byte>(ctrl_reg4_data)
+        .set<high_resolution_bit_mask>();
+    }
+
+    auto const update = [this](hal::byte p_address, hal::byte p_value) {
+      if (cached_register(p_address) != p_value) {
+        write_register(p_address, p_value);
+      }
+    };
+
+    if (p_mode == operating_mode::low_power) {
+      update(ctrl_reg4, ctrl_reg4_data);
+      update(ctrl_reg1, ctrl_reg1_data);
+    } else {
+      update(ctrl_reg1, ctrl_reg1_data);
+      update(ctrl_reg4, ctrl_reg4_data);
+    }
+
+    m_resolution = static_cast<hal::byte>(p_mode);
+    update_conversion();
+  }
+
+  /**
+   * @brief Changes what spi wire mode that the device will use to transfer data
+   *
+   * The CTRL_REG4 bits of the new mode, SIM for SPI, are written first, then
+   * the transport switches its framing. The device listens on SDI in both
+   * modes, so the write lands regardless of which mode the transport was
+   * framing for. Only switch modes if the board wiring supports both, such as
+   * a 4-wire bus whose SDO line is left unused in 3-wire mode.
+   *
+   * @tparam SpiMode - the wire mode type of the transport
+   * @param p_spi_mode - The spi mode that the device will use
+   */
+  template<typename SpiMode>
+    requires requires(Transport& p_transport, SpiMode p_mode) {
+      p_transport.configure_spi_mode(p_mode);
+      { p_transport.ctrl_reg4_bits() } -> std::convertible_to<hal::byte>;
+    }
+  void configure_spi_mode(SpiMode p_spi_mode)
+  {
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto next_transport = m_transport;
+    next_transport.configure_spi_mode(p_spi_mode);
+
+    auto const ctrl_reg4_data = static_cast<hal::byte>(
+      (cached_register(ctrl_reg4) & ~transport_ctrl_reg4()) |
+      next_transport.ctrl_reg4_bits());
+    write_register(ctrl_reg4, ctrl_reg4_data);
+    m_transport = next_transport;
+  }
+
+  /**
+   * @brief Applies a complete device configuration
+   *
+   * CTRL_REG1 through CTRL_REG6 are written with a single auto-increment
+   * write, followed by FIFO_CTRL_REG. Low power mode writes CTRL_REG4 once
+   * more before the burst, see configure_operating_mode(). Features of these
+   * registers not described by settings, including the FIFO watermark, are
+   * returned to their power-on state. Every register in the register cache
+   * is written, so settings left behind by an earlier run of the firmware
+   * never leak into later configuration changes.
+   *
+   * @param p_settings - the configuration to apply to the device
+   */
+  void configure(settings const& p_settings)
+  {
+    auto const latency = measure(&bus_metrics::configure_latency);
+    write_configuration(p_settings);
+    write_fifo_mode(p_settings.fifo);
+  }
+
+  /**
+   * @brief Reads the configuration the device holds and adopts it as the
+   * driver's own
+   *
+   * CTRL_REG1 through CTRL_REG6 are read in a single burst and FIFO_CTRL_REG
+   * in a second transaction, since a burst through the output registers
+   * would pop a sample from the FIFO and roll over before reaching it. The
+   * register cache, full scale and resolution are updated to match, so later
+   * configuration changes keep every setting that was adopted.
+   *
+   * @return settings - the configuration the device holds
+   */
+  settings adopt_configuration()
+  {
+    constexpr auto data_rate_bit_mask = hal::bit_mask::from<7, 4>();
+    constexpr auto low_power_bit_mask = hal::bit_mask::from<3>();
+    constexpr auto full_scale_bit_mask = hal::bit_mask::from<5, 4>();
+    constexpr auto high_resolution_bit_mask = hal::bit_mask::from<3>();
+    constexpr auto fifo_enable_bit_mask = hal::bit_mask::from<6>();
+    constexpr auto fifo_mode_bit_mask = hal::bit_mask::from<7, 6>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto const control_block =
+      std::span(m_registers).first(ctrl_reg6 - ctrl_reg1 + 1);
+    read_registers(ctrl_reg1, control_block);
+    auto const fifo_ctrl =
+      std::span(m_registers).subspan(fifo_ctrl_reg - cached_register_begin, 1);
+    read_registers(fifo_ctrl_reg, fifo_ctrl);
+
+    auto const ctrl_reg1_data = cached_register(ctrl_reg1);
+    auto const ctrl_reg4_data = cached_register(ctrl_reg4);
+    auto const fifo_enabled =
+      hal::bit_extract<fifo_enable_bit_mask>(cached_register(ctrl_reg5));
+
+    settings adopted{
+      .data_rate = static_cast<data_rate_config>(
+        hal::bit_extract<data_rate_bit_mask>(ctrl_reg1_data)),
+      .full_scale = static_cast<max_acceleration>(
+        hal::bit_extract<full_scale_bit_mask>(ctrl_reg4_data)),
+      .mode = operating_mode::normal,
+      .fifo = fifo_mode::bypass,
+    };
+
+    if (hal::bit_extract<low_power_bit_mask>(ctrl_reg1_data)) {
+      adopted.mode = operating_mode::low_power;
+    } else if (hal::bit_extract<high_resolution_bit_mask>(ctrl_reg4_data)) {
+      adopted.mode = operating_mode::high_resolution;
+    }
+
+    if (fifo_enabled) {
+      adopted.fifo = static_cast<fifo_mode>(
+        hal::bit_extract<fifo_mode_bit_mask>(fifo_ctrl[0]));
+    }
+
+    m_gscale = static_cast<hal::byte>(adopted.full_scale);
+    m_resolution = static_cast<hal::byte>(adopted.mode);
+    update_conversion();
+
+    return adopted;
+  }
+
+  /**
+   * @brief Configures how the FIFO collects samples
+   *
+   * Switching to bypass mode empties the FIFO. To restart collection in fifo
+   * mode after the FIFO has filled, switch to bypass mode then back to fifo
+   * mode.
+   *
+   * @param p_mode - the FIFO mode to use
+   */
+  void configure_fifo(fifo_mode p_mode)
+  {
+    constexpr auto fifo_enable_bit_mask = hal::bit_mask::from<6>();
+    constexpr auto fifo_mode_bit_mask = hal::bit_mask::from<7, 6>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto ctrl_reg5_data = cached_register(ctrl_reg5);
+    if (p_mode == fifo_mode::bypass) {
+      hal::bit_modify<hal::byte>(ctrl_reg5_data).clear<fifo_enable_bit_mask>();
+    } else {
+      hal::bit_modify<hal::byte>(ctrl_reg5_data).set<fifo_enable_bit_mask>();
+    }
+    write_register(ctrl_reg5, ctrl_reg5_data);
+
+    auto fifo_ctrl_data = cached_register(fifo_ctrl_reg);
+    hal::bit_modify<hal::byte>(fifo_ctrl_data)
+      .insert<fifo_mode_bit_mask>(static_cast<hal::byte>(p_mode));
+    write_register(fifo_ctrl_reg, fifo_ctrl_data);
+  }
+
+  /**
+   * @brief Applies a calibration to every sample converted to g's
+   *
+   * The model is folded into the per axis conversion coefficients, now and
+   * whenever the full scale or operating mode changes, so calibrated samples
+   * cost the same to convert as uncalibrated ones. Raw samples are never
+   * calibrated, pass calibration() to the configure_calibration() of the
+   * analyzers that consume them.
+   *
+   * @param p_calibration - the model to apply, a default constructed model
+   * removes the calibration
+   */
+  void configure_calibration(calibration_model const& p_calibration)
+  {
+    m_calibration = p_calibration;
+    update_conversion();
+  }
+
+  /**
+   * @return calibration_model const& - the calibration applied to samples
+   */
+  [[nodiscard]] calibration_model const& calibration() const
+  {
+    return m_calibration;
+  }
+
+  /**
+   * @brief Reads and converts one sample without virtual dispatch
+   *
+   * Same result as hal::accelerometer::read() on the bus drivers, but the
+   * transaction, parsing and scaling are visible to the compiler and can be
+   * inlined into the caller.
+   *
+   * @return accelerometer::read_t - acceleration in g's
+   */
+  accelerometer::read_t read()
+  {
+    return apply_conversion(read_raw());
+  }
+
+  /**
+   * @brief Reads the current sample without converting it to g's
+   *
+   * @return raw_read_t - the sample in digits along with the full scale and
+   * resolution needed to interpret it
+   */
+  raw_read_t read_raw()
+  {
+    auto const latency = measure(&bus_metrics::read_latency);
+
+    std::array<hal::byte, bytes_per_sample> xyz_acceleration{};
+    read_registers(out_x_l, xyz_acceleration);
+
+    return parse_raw(xyz_acceleration, m_gscale, m_resolution);
+  }
+
+  /**
+   * @brief Reads the status register and the current sample in a single
+   * 7 byte auto-increment burst
+   *
+   * Polling this faster than the output data rate yields new_data == false
+   * for repeated samples, polling slower than the output data rate is
+   * reported through overrun.
+   *
+   * @return status_read_t - the sample and its data status flags
+   */
+  status_read_t read_with_status()
+  {
+    constexpr auto new_data_bit_mask = hal::bit_mask::from<3>();
+    constexpr auto overrun_bit_mask = hal::bit_mask::from<7>();
+
+    auto const latency = measure(&bus_metrics::read_latency);
+
+    std::array<hal::byte, 1 + bytes_per_sample> status_and_xyz{};
+    read_registers(status_reg, status_and_xyz);
+
+    auto const status = status_and_xyz[0];
+    return status_read_t{
+      .acceleration =
+        apply_conversion(parse_raw(std::span(status_and_xyz).subspan(1),
+                                   m_gscale,
+                                   m_resolution)),
+      .new_data = hal::bit_extract<new_data_bit_mask>(status) != 0,
+      .overrun = hal::bit_extract<overrun_bit_mask>(status) != 0,
+    };
+  }
+
+  /**
+   * @brief Drains the samples stored in the FIFO with a single burst read
+   *
+   * The FIFO source register is read to determine how many samples are
+   * stored, then all of them are read in one auto-increment transaction.
+   *
+   * @param p_samples - buffer to fill with samples, oldest sample first. If
+   * the buffer is smaller than the number of stored samples, the remaining
+   * samples are left in the FIFO for the next call.
+   * @return std::span<accelerometer::read_t> - the portion of p_samples that
+   * was filled with samples. Empty if the FIFO held no samples.
+   */
+  std::span<accelerometer::read_t> read_fifo(
+    std::span<accelerometer::read_t> p_samples)
+  {
+    std::array<raw_read_t, fifo_depth> raw_samples{};
+    auto const raw = read_fifo(
+      std::span(raw_samples).first(std::min(p_samples.size(), fifo_depth)));
+
+    std::ranges::transform(
+      raw, p_samples.begin(), [this](raw_read_t const& p_raw) {
+        return apply_conversion(p_raw);
+      });
+
+    return p_samples.first(raw.size());
+  }
+
+  /**
+   * @brief Drains the samples stored in the FIFO without converting them to
+   * g's
+   *
+   * @param p_samples - buffer to fill with raw samples, oldest sample first
+   * @return std::span<raw_read_t> - the portion of p_samples that was filled
+   * with samples. Empty if the FIFO held no samples.
+   */
+  std::span<raw_read_t> read_fifo(std::span<raw_read_t> p_samples)
+  {
+    auto const latency = measure(&bus_metrics::read_latency);
+    return drain_fifo(read_fifo_count(), p_samples);
+  }
+
+  // adaptive_watermark cannot include this header, so its copy of the FIFO
+  // depth is checked here
+  static_assert(adaptive_watermark::fifo_depth == fifo_depth,
+                "adaptive_watermark sizes its watermarks for another FIFO");
+
+  /**
+   * @brief Drains the FIFO and lets p_policy adjust the watermark level
+   *
+   * The number of stored samples reported by the FIFO source register is
+   * given to p_policy. The watermark is only written to the device when the
+   * policy changes it.
+   *
+   * @param p_samples - buffer to fill with raw samples, oldest sample first
+   * @param p_policy - the adaptive watermark policy to update
+   * @return std::span<raw_read_t> - the portion of p_samples that was filled
+   * with samples. Empty if the FIFO held no samples.
+   */
+  std::span<raw_read_t> read_fifo(std::span<raw_read_t> p_samples,
+                                  adaptive_watermark& p_policy)
+  {
+    constexpr auto watermark_bit_mask = hal::bit_mask::from<4, 0>();
+
+    std::size_t stored = 0;
+    std::span<raw_read_t> samples{};
+    {
+      // the watermark write below is timed as a configuration change
+      auto const latency = measure(&bus_metrics::read_latency);
+      stored = read_fifo_count();
+      samples = drain_fifo(stored, p_samples);
+    }
+
+    auto const watermark = p_policy.update(stored);
+    auto const active_watermark =
+      hal::bit_extract<watermark_bit_mask>(cached_register(fifo_ctrl_reg));
+    if (watermark != active_watermark) {
+      configure_fifo_watermark(watermark);
+    }
+
+    return samples;
+  }
+
+  /**
+   * @brief Drains the FIFO and stamps each sample with its acquisition time
+   *
+   * p_clock is read right after the FIFO source register. The newest stored
+   * sample was acquired during the sample period before that, so it is
+   * stamped half a period earlier, and each older sample one period before
+   * the next. Timestamps are therefore within half a sample period of the
+   * true acquisition time, without an interrupt per sample.
+   *
+   * @param p_samples - buffer to fill with samples, oldest sample first
+   * @param p_clock - the clock the timestamps are taken from
+   * @return std::span<timestamped_read_t> - the portion of p_samples that was
+   * filled with samples. Empty if the FIFO held no samples.
+   */
+  std::span<timestamped_read_t> read_fifo(
+    std::span<timestamped_read_t> p_samples,
+    hal::steady_clock& p_clock)
+  {
+    auto const latency = measure(&bus_metrics::read_latency);
+    auto const stored = read_fifo_count();
+    auto const now = p_clock.uptime();
+    auto const ticks_per_sample = sample_period(p_clock);
+
+    auto const newest = static_cast<float>(stored) - 1.0f;
+    return drain_timestamped(
+      stored,
+      p_samples,
+      sample_timing{
+        .anchor_ticks = now - static_cast<std::uint64_t>(ticks_per_sample / 2),
+        .anchor_index = newest,
+        .ticks_per_sample = ticks_per_sample,
+      });
+  }
+
+  /**
+   * @brief Drains the FIFO and stamps each sample relative to the watermark
+   * interrupt
+   *
+   * The watermark signal rises when the sample at index FTH (the watermark
+   * level) is stored, so a tick captured in the INT1 interrupt handler marks
+   * that sample to within the interrupt latency. Every other sample is one
+   * sample period apart. This holds when each drain empties the FIFO, as
+   * read_fifo() does when p_samples can hold fifo_depth samples.
+   *
+   * @param p_samples - buffer to fill with samples, oldest sample first
+   * @param p_clock - the clock p_watermark_ticks was taken from
+   * @param p_watermark_ticks - uptime of p_clock when the watermark interrupt
+   * fired
+   * @return std::span<timestamped_read_t> - the portion of p_samples that was
+   * filled with samples. Empty if the FIFO held no samples.
+   */
+  std::span<timestamped_read_t> read_fifo(
+    std::span<timestamped_read_t> p_samples,
+    hal::steady_clock& p_clock,
+    std::uint64_t p_watermark_ticks)
+  {
+    constexpr auto watermark_bit_mask = hal::bit_mask::from<4, 0>();
+
+    auto const latency = measure(&bus_metrics::read_latency);
+    auto const stored = read_fifo_count();
+    auto const watermark =
+      hal::bit_extract<watermark_bit_mask>(cached_register(fifo_ctrl_reg));
+
+    return drain_timestamped(stored,
+                             p_samples,
+                             sample_timing{
+                               .anchor_ticks = p_watermark_ticks,
+                               .anchor_index = static_cast<float>(watermark),
+                               .ticks_per_sample = sample_period(p_clock),
+                             });
+  }
+
+  /**
+   * @brief Drains the FIFO, refines p_estimator and stamps each sample with
+   * the drift corrected acquisition time
+   *
+   * The drain is anchored like read_fifo(p_samples, p_clock), and the anchor
+   * is given to p_estimator as one observation. The samples are then stamped
+   * from the estimator's fit rather than the nominal period. An overrun means
+   * samples were lost, so the estimator is resynchronized first.
+   *
+   * @param p_samples - buffer to fill with samples, oldest sample first
+   * @param p_clock - the clock the timestamps are taken from
+   * @param p_estimator - estimator of the true data rate, constructed with
+   * the active data rate and p_clock's frequency
+   * @return std::span<timestamped_read_t> - the portion of p_samples that was
+   * filled with samples. Empty if the FIFO held no samples.
+   */
+  std::span<timestamped_read_t> read_fifo(
+    std::span<timestamped_read_t> p_samples,
+    hal::steady_clock& p_clock,
+    sample_rate_estimator& p_estimator)
+  {
+    auto const latency = measure(&bus_metrics::read_latency);
+    auto const stored = read_fifo_count();
+    auto const now = p_clock.uptime();
+
+    if (stored == fifo_depth) {
+      p_estimator.resynchronize();
+    }
+
+    auto const first = p_estimator.next_index();
+    if (stored > 0) {
+      auto const half_period =
+        static_cast<std::uint64_t>(p_estimator.ticks_per_sample() / 2);
+      p_estimator.update(first + stored - 1, now - half_period);
+    }
+
+    std::array<raw_read_t, fifo_depth> raw_samples{};
+    auto const raw = drain_fifo(
+      stored,
+      std::span(raw_samples).first(std::min(p_samples.size(), fifo_depth)));
+
+    for (std::size_t i = 0; i < raw.size(); i++) {
+      p_samples[i] = timestamped_read_t{
+        .sample = raw[i],
+        .ticks = p_estimator.ticks(first + i),
+      };
+    }
+    p_estimator.advance(raw.size());
+
+    return p_samples.first(raw.size());
+  }
+
+  /**
+   * @brief Routes the data ready signal (I1_ZYXDA) to the INT1 pin
+   *
+   * Samples read by handle_data_ready() are pushed into p_buffer until they
+   * are collected with read_buffered() or popped from p_buffer directly.
+   * INT1 stays high until the sample is read, so the interrupt should trigger
+   * on the rising edge.
+   *
+   * The driver only keeps a pointer to p_buffer, which keeps the driver
+   * small and copyable. A copy of the driver pushes into the same buffer.
+   *
+   * @param p_buffer - buffer for the samples, must outlive the driver or the
+   * next call to this function
+   */
+  void enable_data_ready_interrupt(spsc_ring_buffer<raw_read_t>& p_buffer)
+  {
+    constexpr auto data_ready_int1_bit_mask = hal::bit_mask::from<4>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    m_data_ready_samples = &p_buffer;
+
+    auto ctrl_reg3_data = cached_register(ctrl_reg3);
+    hal::bit_modify<hal::byte>(ctrl_reg3_data).set<data_ready_int1_bit_mask>();
+    write_register(ctrl_reg3, ctrl_reg3_data);
+  }
+
+  /**
+   * @brief Stops routing the data ready signal to the INT1 pin
+   */
+  void disable_data_ready_interrupt()
+  {
+    constexpr auto data_ready_int1_bit_mask = hal::bit_mask::from<4>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto ctrl_reg3_data = cached_register(ctrl_reg3);
+    hal::bit_modify<hal::byte>(ctrl_reg3_data)
+      .clear<data_ready_int1_bit_mask>();
+    write_register(ctrl_reg3, ctrl_reg3_data);
+  }
+
+  /**
+   * @brief Reads the new sample into the buffer given to
+   * enable_data_ready_interrupt()
+   *
+   * Call this from the INT1 interrupt handler. If the buffer is full, the new
+   * sample is dropped. No other code may use the bus while this runs.
+   *
+   * The read is not counted in the attached bus_metrics, so their plain
+   * counters are never written from an interrupt while a task updates them.
+   */
+  void handle_data_ready()
+  {
+    if (not m_data_ready_samples) {
+      return;
+    }
+
+    std::array<hal::byte, bytes_per_sample> xyz_acceleration{};
+    m_transport.transaction(std::array{ Transport::read_command(out_x_l) },
+                            xyz_acceleration);
+    m_data_ready_samples->push(
+      parse_raw(xyz_acceleration, m_gscale, m_resolution));
+  }
+
+  /**
+   * @brief Collects samples buffered by handle_data_ready()
+   *
+   * Safe to call while handle_data_ready() runs in an interrupt.
+   *
+   * @param p_samples - buffer to fill with samples, oldest sample first
+   * @return std::span<raw_read_t> - the portion of p_samples that was filled
+   */
+  std::span<raw_read_t> read_buffered(std::span<raw_read_t> p_samples)
+  {
+    if (not m_data_ready_samples) {
+      return p_samples.first(0);
+    }
+    return m_data_ready_samples->pop_batch(p_samples);
+  }
+
+  /**
+   * @brief Enables the FIFO and routes its watermark signal (I1_WTM) to the
+   * INT1 pin
+   *
+   * INT1 is raised once more than p_watermark samples are stored, which lets
+   * the host sleep through p_watermark + 1 samples instead of waking for
+   * every sample. Stream mode is selected if the FIFO is in bypass mode. Drain
+   * the FIFO with read_fifo() from the task woken by the interrupt.
+   *
+   * @param p_watermark - watermark level (FTH), 0 to 31
+   */
+  void enable_watermark_interrupt(hal::byte p_watermark)
+  {
+    constexpr auto watermark_int1_bit_mask = hal::bit_mask::from<2>();
+    constexpr auto fifo_enable_bit_mask = hal::bit_mask::from<6>();
+    constexpr auto fifo_mode_bit_mask = hal::bit_mask::from<7, 6>();
+    constexpr auto watermark_bit_mask = hal::bit_mask::from<4, 0>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto ctrl_reg3_data = cached_register(ctrl_reg3);
+    auto ctrl_reg5_data = cached_register(ctrl_reg5);
+    hal::bit_modify<hal::byte>(ctrl_reg3_data).set<watermark_int1_bit_mask>();
+    hal::bit_modify<hal::byte>(ctrl_reg5_data).set<fifo_enable_bit_mask>();
+
+    auto fifo_ctrl_data = cached_register(fifo_ctrl_reg);
+    auto const mode = hal::bit_extract<fifo_mode_bit_mask>(fifo_ctrl_data);
+    if (mode == static_cast<hal::byte>(fifo_mode::bypass)) {
+      hal::bit_modify<hal::byte>(fifo_ctrl_data)
+        .insert<fifo_mode_bit_mask>(static_cast<hal::byte>(fifo_mode::stream));
+    }
+    hal::bit_modify<hal::byte>(fifo_ctrl_data)
+      .insert<watermark_bit_mask>(p_watermark);
+
+    // FIFO_EN is written before FIFO_CTRL_REG so the FIFO starts collecting
+    // with the new watermark already in place.
+    write_registers(ctrl_reg3,
+                    std::array{
+                      ctrl_reg3_data,
+                      cached_register(ctrl_reg4),
+                      ctrl_reg5_data,
+                    });
+    write_register(fifo_ctrl_reg, fifo_ctrl_data);
+  }
+
+  /**
+   * @brief Stops routing the FIFO watermark signal to the INT1 pin, the FIFO
+   * remains enabled
+   */
+  void disable_watermark_interrupt()
+  {
+    constexpr auto watermark_int1_bit_mask = hal::bit_mask::from<2>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto ctrl_reg3_data = cached_register(ctrl_reg3);
+    hal::bit_modify<hal::byte>(ctrl_reg3_data).clear<watermark_int1_bit_mask>();
+    write_register(ctrl_reg3, ctrl_reg3_data);
+  }
+
+  /**
+   * @brief Changes the FIFO watermark level (FTH) with a single write
+   *
+   * @param p_watermark - watermark level, 0 to 31
+   */
+  void configure_fifo_watermark(hal::byte p_watermark)
+  {
+    constexpr auto watermark_bit_mask = hal::bit_mask::from<4, 0>();
+
+    auto const latency = measure(&bus_metrics::configure_latency);
+
+    auto fifo_ctrl_data = cached_register(fifo_ctrl_reg);
+    hal::bit_modify<hal::byte>(fifo_ctrl_data)
+      .insert<watermark_bit_mask>(p_watermark);
+    write_register(fifo_ctrl_reg, fifo_ctrl_data);
+  }
+
+  /**
+   * @brief Starts counting bus traffic and call latency into p_metrics
+   *
+   * Every bus transaction updates the transaction, byte and chip select
+   * counters. Calls that read samples and calls that change the configuration
+   * are timed with p_clock and recorded in separate latency histograms. While
+   * detached, the only cost is a null check per call and per transaction.
+   * handle_data_ready() runs in an interrupt and is never counted.
+   *
+   * @param p_metrics - counters to update, must outlive the attachment
+   * @param p_clock - clock used to time calls
+   */
+  void attach_metrics(bus_metrics& p_metrics, hal::steady_clock& p_clock)
+  {
+    m_clock = &p_clock;
+    m_metrics = &p_metrics;
+  }
+
+  /**
+   * @brief Stops updating the counters given to attach_metrics()
+   */
+  void detach_metrics()
+  {
+    m_metrics = nullptr;
+  }
+
+protected:
+  /**
+   * @brief Returns the cached value of a configuration register
+   *
+   * @param p_address - address of the register, must be within the cache
+   * @return hal::byte - the last value written to or read from the register
+   */
+  hal::byte cached_register(hal::byte p_address)
+  {
+    return m_registers[p_address - cached_register_begin];
+  }
+
+  /**
+   * @brief Writes a configuration register and updates the register cache
+   *
+   * @param p_address - address of the register, must be within the cache
+   * @param p_value - value to write to the register
+   */
+  void write_register(hal::byte p_address, hal::byte p_value)
+  {
+    write_registers(p_address, std::array{ p_value });
+  }
+
+  /**
+   * @brief Writes consecutive configuration registers in a single
+   * auto-increment transaction and updates the register cache
+   *
+   * @param p_first - address of the first register, must be within the cache
+   * @param p_values - values to write starting at p_first
+   */
+  void write_registers(hal::byte p_first, std::span<hal::byte const> p_values)
+  {
+    std::array<hal::byte, 1 + std::tuple_size_v<decltype(m_registers)>>
+      buffer{};
+    buffer[0] = Transport::write_command(p_first);
+    std::ranges::copy(p_values, buffer.begin() + 1);
+
+    transaction(std::span(buffer).first(1 + p_values.size()), {});
+
+    std::ranges::copy(p_values,
+                      m_registers.begin() + (p_first - cached_register_begin));
+  }
+
+  /**
+   * @brief Reads consecutive registers in a single auto-increment transaction
+   *
+   * @param p_first - address of the first register
+   * @param p_values - buffer to fill starting with p_first
+   */
+  void read_registers(hal::byte p_first, std::span<hal::byte> p_values)
+  {
+    transaction(std::array{ Transport::read_command(p_first) }, p_values);
+  }
+
+  /// The bus the device is connected to
+  Transport m_transport;
+
+private:
+  /**
+   * @brief Returns the CTRL_REG4 bits required by the transport
+   */
+  hal::byte transport_ctrl_reg4() const
+  {
+    if constexpr (requires {
+                    {
+                      m_transport.ctrl_reg4_bits()
+                    } -> std::convertible_to<hal::byte>;
+                  }) {
+      return m_transport.ctrl_reg4_bits();
+    } else {
+      return 0;
+    }
+  }
+
+  /**
+   * @brief Writes CTRL_REG1 through CTRL_REG6 for a complete device
+   * configuration, see configure()
+   *
+   * @param p_settings - the configuration to apply to the device
+   */
+  void write_configuration(settings const& p_settings)
+  {
+    constexpr auto data_rate_bit_mask = hal::bit_mask::from<7, 4>();
+    constexpr auto axis_enable_bit_mask = hal::bit_mask::from<2, 0>();
+    constexpr auto full_scale_bit_mask = hal::bit_mask::from<5, 4>();
+    constexpr auto fifo_enable_bit_mask = hal::bit_mask::from<6>();
+    constexpr auto low_power_bit_mask = hal::bit_mask::from<3>();
+    constexpr auto high_resolution_bit_mask = hal::bit_mask::from<3>();
+
+    auto const data_rate = static_cast<hal::byte>(p_settings.data_rate);
+    auto const full_scale = static_cast<hal::byte>(p_settings.full_scale);
+
+    m_gscale = full_scale;
+    m_resolution = static_cast<hal::byte>(p_settings.mode);
+    update_conversion();
+
+    auto ctrl_reg1_data = hal::bit_value<std::uint32_t>(0U)
+                            .insert<data_rate_bit_mask>(data_rate)
+                            .set<axis_enable_bit_mask>()
+                            .to<hal::byte>();
+    auto ctrl_reg4_data = hal::bit_value<std::uint32_t>(transport_ctrl_reg4())
+                            .insert<full_scale_bit_mask>(full_scale)
+                            .to<hal::byte>();
+    if (p_settings.mode == operating_mode::low_power) {
+      hal::bit_modify<hal::byte>(ctrl_reg1_data).set<low_power_bit_mask>();
+    } else if (p_settings.mode == operating_mode::high_resolution) {
+      hal::bit_modify<hal::byte>(ctrl_reg4_data)
+        .set<high_resolution_bit_mask>();
+    }
+
+    auto ctrl_reg5_data = hal::bit_value<std::uint32_t>(0U);
+    if (p_settings.fifo != fifo_mode::bypass) {
+      ctrl_reg5_data.set<fifo_enable_bit_mask>();
+    }
+
+    // The burst reaches CTRL_REG1 before CTRL_REG4, so HR is cleared first
+    // when entering low power mode. The device may still be in high
+    // resolution mode from before an MCU reset, so this does not rely on the
+    // register cache.
+    if (p_settings.mode == operating_mode::low_power) {
+      write_register(ctrl_reg4, ctrl_reg4_data);
+    }
+
+    write_registers(ctrl_reg1,
+                    std::array<hal::byte, ctrl_reg6 - ctrl_reg1 + 1>{
+                      ctrl_reg1_data,
+                      0,
+                      0,
+                      ctrl_reg4_data,
+                      ctrl_reg5_data.to<hal::byte>(),
+                      0,
+                    });
+  }
+
+  /**
+   * @brief Writes FIFO_CTRL_REG with a FIFO mode and the power-on watermark
+   *
+   * @param p_mode - the FIFO mode to write
+   */
+  void write_fifo_mode(fifo_mode p_mode)
+  {
+    constexpr auto fifo_mode_bit_mask = hal::bit_mask::from<7, 6>();
+
+    auto const fifo_ctrl_data =
+      hal::bit_value<std::uint32_t>(0U)
+        .insert<fifo_mode_bit_mask>(static_cast<hal::byte>(p_mode))
+        .to<hal::byte>();
+    write_register(fifo_ctrl_reg, fifo_ctrl_data);
+  }
+
+  /**
+   * @brief Folds the sensitivity of the active full scale and resolution and
+   * the calibration into m_conversion
+   */
+  void update_conversion()
+  {
+    m_conversion = conversion_for(
+      m_calibration, static_cast<max_acceleration>(m_gscale), m_resolution);
+  }
+
+  /**
+   * @brief Converts a sample to calibrated g's with the folded coefficients
+   */
+  accelerometer::read_t apply_conversion(raw_read_t const& p_raw) const
+  {
+    return convert(p_raw, m_conversion);
+  }
+
+  /**
+   * @brief Reads the FIFO source register
+   *
+   * @return std::size_t - the number of samples stored in the FIFO
+   */
+  std::size_t read_fifo_count()
+  {
+    constexpr auto overrun_bit_mask = hal::bit_mask::from<6>();
+    constexpr auto stored_samples_bit_mask = hal::bit_mask::from<4, 0>();
+
+    std::array<hal::byte, 1> fifo_src{};
+    read_registers(fifo_src_reg, fifo_src);
+
+    // FSS only counts up to 31, the overrun flag indicates that all 32 slots
+    // of the FIFO are filled.
+    if (hal::bit_extract<overrun_bit_mask>(fifo_src[0])) {
+      if (m_metrics) {
+        m_metrics->fifo_overruns++;
+      }
+      return fifo_depth;
+    }
+    return hal::bit_extract<stored_samples_bit_mask>(fifo_src[0]);
+  }
+
+  /**
+   * @brief Relates the position of a sample in a drain to its acquisition
+   * time
+   */
+  struct sample_timing
+  {
+    /// Acquisition time of the sample at anchor_index
+    std::uint64_t anchor_ticks;
+    /// Position in the drain of the sample acquired at anchor_ticks
+    float anchor_index;
+    /// Clock ticks between consecutive samples
+    float ticks_per_sample;
+  };
+
+  /**
+   * @brief Returns the clock ticks between samples at the active data rate
+   *
+   * @param p_clock - the clock the ticks are counted in
+   * @return float - ticks per sample, 0 when powered down
+   */
+  float sample_period(hal::steady_clock& p_clock)
+  {
+    constexpr auto data_rate_bit_mask = hal::bit_mask::from<7, 4>();
+
+    auto const data_rate = static_cast<data_rate_config>(
+      hal::bit_extract<data_rate_bit_mask>(cached_register(ctrl_reg1)));
+    auto const rate =
+      output_data_rate(data_rate, static_cast<operating_mode>(m_resolution));
+    return rate > 0.0f ? p_clock.frequency() / rate : 0.0f;
+  }
+
+  /**
+   * @brief Drains the FIFO and stamps every sample using p_timing
+   *
+   * @param p_stored - the number of samples stored in the FIFO
+   * @param p_samples - buffer to fill with samples, oldest sample first
+   * @param p_timing - the acquisition time of one sample and the period
+   * @return std::span<timestamped_read_t> - the portion of p_samples that was
+   * filled with samples
+   */
+  std::span<timestamped_read_t> drain_timestamped(
+    std::size_t p_stored,
+    std::span<timestamped_read_t> p_samples,
+    sample_timing const& p_timing)
+  {
+    std::array<raw_read_t, fifo_depth> raw_samples{};
+    auto const raw = drain_fifo(
+      p_stored,
+      std::span(raw_samples).first(std::min(p_samples.size(), fifo_depth)));
+
+    for (std::size_t i = 0; i < raw.size(); i++) {
+      auto const offset = (static_cast<float>(i) - p_timing.anchor_index) *
+                          p_timing.ticks_per_sample;
+      p_samples[i] = timestamped_read_t{
+        .sample = raw[i],
+        .ticks = p_timing.anchor_ticks +
+                 static_cast<std::uint64_t>(std::llround(offset)),
+      };
+    }
+
+    return p_samples.first(raw.size());
+  }
+
+  /**
+   * @brief Reads p_stored samples from the FIFO in a single burst
+   *
+   * @param p_stored - number of samples stored in the FIFO
+   * @param p_samples - buffer to fill, at most its size samples are read
+   * @return std::span<raw_read_t> - the portion of p_samples that was filled
+   */
+  std::span<raw_read_t> drain_fifo(std::size_t p_stored,
+                                   std::span<raw_read_t> p_samples)
+  {
+    auto const sample_count = std::min(p_stored, p_samples.size());
+    if (sample_count == 0) {
+      return p_samples.first(0);
+    }
+
+    // With the FIFO enabled, the auto-increment address rolls over from
+    // OUT_Z_H back to OUT_X_L, which allows the whole FIFO to be drained in
+    // one read.
+    std::array<hal::byte, fifo_depth * bytes_per_sample> buffer{};
+    auto payload = std::span(buffer).first(sample_count * bytes_per_sample);
+    read_registers(out_x_l, payload);
+
+    for (std::size_t i = 0; i < sample_count; i++) {
+      p_samples[i] =
+        parse_raw(payload.subspan(i * bytes_per_sample, bytes_per_sample),
+                  m_gscale,
+                  m_resolution);
+    }
+
+    return p_samples.first(sample_count);
+  }
+
+  /**
+   * @brief Performs a single bus transaction with the device and updates the
+   * attached metrics
+   *
+   * @param p_data_out - bytes to write, starting with the command byte
+   * @param p_data_in - bytes to read after the write
+   */
+  void transaction(std::span<hal::byte const> p_data_out,
+                   std::span<hal::byte> p_data_in)
+  {
+    m_transport.transaction(p_data_out, p_data_in);
+
+    if (m_metrics) {
+      m_metrics->transactions++;
+      m_metrics->chip_selects += Transport::chip_selects_per_transaction;
+      m_metrics->bytes += p_data_out.size() + p_data_in.size();
+    }
+  }
+
+  /**
+   * @brief Starts timing a call if metrics are attached
+   *
+   * @param p_member - the histogram of bus_metrics to record into
+   * @return scoped_latency - records the latency when destroyed
+   */
+  scoped_latency measure(latency_histogram bus_metrics::*p_member)
+  {
+    return { m_metrics ? &(m_metrics->*p_member) : nullptr, m_clock };
+  }
+
+  /// The minimum and maxium g's that the device will read
+  hal::byte m_gscale = 0;
+  /// The number of significant bits per axis of the active operating mode
+  hal::byte m_resolution = 0;
+  /// Buffer given to enable_data_ready_interrupt(), null until then
+  spsc_ring_buffer<raw_read_t>* m_data_ready_samples = nullptr;
+  /// Corrections applied to every converted sample
+  calibration_model m_calibration{};
+  /// The sensitivity of the active full scale and resolution folded together
+  /// with the calibration, so converting a sample costs one multiply and add
+  /// per axis
+  conversion m_conversion{};
+  /// Counters updated while attached, null when instrumentation is disabled
+  bus_metrics* m_metrics = nullptr;
+  /// Clock used to time calls while metrics are attached
+  hal::steady_clock* m_clock = nullptr;
+  /// Shadow copy of the registers from CTRL_REG1 (0x20) through
+  /// FIFO_CTRL_REG (0x2E), indexed by the register's offset from CTRL_REG1.
+  /// Keeping this copy allows configuration changes to be write-only. Only
+  /// CTRL_REG1 through CTRL_REG6 and FIFO_CTRL_REG are held, and every
+  /// constructor writes or reads all of them, so the copy never depends on
+  /// the device still holding its power-on values. The one exception is the
+  /// fast start constructor with the FIFO bypassed, which leaves FIFO_CTRL_REG
+  /// unwritten while FIFO_EN keeps it inert, and FIFO_CTRL_REG is only ever
+  /// written whole.
+  std::array<hal::byte, cached_register_end - cached_register_begin + 1>
+    m_registers{};
+};
+}  // namespace hal::stm_imu
@@ -14,13 +14,83 @@
 
 #pragma once
 
+#include <cstdint>
+#include <span>
+
 #include <libhal-util/bit.hpp>
 #include <libhal-util/i2c.hpp>
-#include <libhal-util/map.hpp>
 #include <libhal/accelerometer.hpp>
+#include <libhal/i2c.hpp>
+
+#include "lis3dhtr_core.hpp"
 
 namespace hal::stm_imu {
-class lis3dhtr_i2c : public hal::accelerometer
+/**
+ * @brief I2C transport for lis3dhtr_core
+ *
+ * Register addresses are sent as the I2C sub-address with bit 7 set, which
+ * enables auto-increment for multi-byte reads and writes.
+ */
+class lis3dhtr_i2c_transport
+{
+public:
+  /// I2C has no chip select
+  static constexpr std::uint32_t chip_selects_per_transaction = 0;
+
+  /**
+   * @param p_i2c - I2C bus the lis is connected to
+   * @param p_device_address - address of the lis3dhtr
+   */
+  lis3dhtr_i2c_transport(hal::i2c& p_i2c, hal::byte p_device_address)
+    : m_i2c(&p_i2c)
+    , m_address(p_device_address)
+  {
+  }
+
+  static constexpr hal::byte read_command(hal::byte p_register)
+  {
+    return hal::bit_value(p_register)
+      .set<address_increment_bit_mask>()
+      .to<hal::byte>();
+  }
+
+  static constexpr hal::byte write_command(hal::byte p_register)
+  {
+    return read_command(p_register);
+  }
+
+  void transaction(std::span<hal::byte const> p_data_out,
+                   std::span<hal::byte> p_data_in)
+  {
+    m_i2c->transaction(m_address, p_data_out, p_data_in, hal::never_timeout());
+  }
+
+private:
+  // this is the bit mask to indicate a auto increment address on i2c
+  static constexpr auto address_increment_bit_mask = hal::bit_mask::from<7>();
+
+  /// The I2C peripheral used for communication with the device.
+  hal::i2c* m_i2c;
+  /// The configurable device address used for communication.
+  hal::byte m_address;
+};
+
+/**
+ * @brief Non-virtual lis3dhtr driver over I2C
+ *
+ * Provides the same operations as lis3dhtr_i2c, but read() is an inline
+ * member rather than an override of hal::accelerometer::driver_read(). Use it
+ * in tight loops where the call through the accelerometer interface would
+ * keep the sample conversion from being inlined.
+ */
+using lis3dhtr_i2c_core = lis3dhtr_core<lis3dhtr_i2c_transport>;
+
+/**
+ * @brief hal::accelerometer adapter over lis3dhtr_i2c_core
+ */
+class lis3dhtr_i2c
+  : public hal::accelerometer
+  , public lis3dhtr_core<lis3dhtr_i2c_transport>
 {
 public:
   /**
@@ -32,79 +102,6 @@ public:
    */
   static constexpr hal::byte high_address = 0b0001'1001;
 
-  /**
-   * @brief max_acceleration is the maxium g's that the device will read
-   * NOTE: the higher the max gravity you select, the lower your resolution is
-   */
-  enum class max_acceleration : hal::byte
-  {
-    /**
-     * @brief 2x the average earth gravity, acceleration
-     */
-    g2 = 0x00,
-    /**
-     * @brief 4x the average earth gravity, acceleration
-     */
-    g4 = 0x01,
-    /**
-     * @brief 8x the average earth gravity, acceleration
-     */
-    g8 = 0x02,
-    /**
-     * @brief 16x the average earth gravity, acceleration
-     */
-    g16 = 0x03,
-  };
-
-  /**
-   * @brief data_rate_config are the different data rates that the imu can be
-   * programmed to output data at in the different modes
-   */
-  enum class data_rate_config : hal::byte
-  {
-    /**
-     * @brief 0Hz (this is the power down command)
-     */
-    mode_0 = 0b0000,
-    /**
-     * @brief 1Hz
-     */
-    mode_1 = 0b0001,
-    /**
-     * @brief 10Hz
-     */
-    mode_2 = 0b0010,
-    /**
-     * @brief 25Hz
-     */
-    mode_3 = 0b0011,
-    /**
-     * @brief 50Hz
-     */
-    mode_4 = 0b0100,
-    /**
-     * @brief 100Hz
-     */
-    mode_5 = 0b0101,
-    /**
-     * @brief 200Hz
-     */
-    mode_6 = 0b0110,
-    /**
-     * @brief 400Hz
-     */
-    mode_7 = 0b0111,
-    /**
-     * @brief just low power mode is configured in this one to 1.6kHz
-     * this is also the default mode set by power_on
-     */
-    mode_8 = 0b1000,
-    /**
-     * @brief High resolution = normal = 1.344kHz; low power mode = 5.376kHz
-     */
-    mode_9 = 0b1001,
-  };
-
   /**
    * @brief Constructs lis object
    *
@@ -122,48 +119,55 @@ public:
                max_acceleration p_gscale = max_acceleration::g2);
 
   /**
-   * @brief verify's that the device exists on the I2C line
+   * @brief Constructs lis object with a complete device configuration
+   *
+   * After verifying the device, CTRL_REG1 through CTRL_REG6 are written in a
+   * single burst, followed by FIFO_CTRL_REG.
+   *
+   * @param p_i2c - I2C bus the lis is connected to
+   * @param p_device_address - address of the lis3dhtr_i2c
+   * @param p_settings - the configuration to apply to the device
    *
    * @throws hal::no_such_device - when ID register does not match
+   * the expected ID for the lis3dhtr_i2c device.
    */
-  void verify_device();
+  lis3dhtr_i2c(i2c& p_i2c,
+               hal::byte p_device_address,
+               settings const& p_settings);
 
   /**
-   * @brief enables acceleration readings from the lis
+   * @brief Constructs lis object without verifying the device
    *
-   */
-  void power_on();
-
-  /**
-   * @brief Disables acceleration reading from the lis3dhtr_i2c.
+   * Writes CTRL_REG1..6 in one burst, followed by FIFO_CTRL_REG unless the
+   * FIFO is bypassed, and reads nothing back. Call device_present() or
+   * verify_device() later to confirm the device.
    *
+   * @param p_i2c - I2C bus the lis is connected to
+   * @param p_device_address - address of the lis3dhtr_i2c
+   * @param p_settings - the configuration to apply to the device
    */
-  void power_off();
+  lis3dhtr_i2c(i2c& p_i2c,
+               hal::byte p_device_address,
+               settings const& p_settings,
+               fast_start_t);
 
   /**
-   * @brief Configures the frequency that new data can be read from the device
+   * @brief Constructs lis object from the configuration the device already
+   * holds
    *
-   * @param p_data_rate - the frequency that new data can be read from the
-   * device
-   */
-  void configure_data_rates(data_rate_config p_data_rate);
-
-  /**
-   * @brief Changes the gravity scale that the lis is reading. The larger the
-   * scale, the less precise the reading.
+   * Used after an MCU reset to resume streaming without reconfiguring the
+   * device, which keeps the samples already in its FIFO. See
+   * lis3dhtr_core::adopt_configuration().
    *
-   * @param p_gravity_code - Scales in powers of 2 up to 16.
+   * @param p_i2c - I2C bus the lis is connected to
+   * @param p_device_address - address of the lis3dhtr_i2c
    */
-  void configure_full_scale(max_acceleration p_gravity_code);
+  lis3dhtr_i2c(i2c& p_i2c, hal::byte p_device_address, warm_restart_t);
+
+  /// read() goes through hal::accelerometer, lis3dhtr_core::read() does not
+  using hal::accelerometer::read;
 
 private:
   accelerometer::read_t driver_read() override;
-
-  /// The I2C peripheral used for communication with the device.
-  hal::i2c* m_i2c;
-  /// The configurable device address used for communication.
-  hal::byte m_address;
-  /// The minimum and maxium g's that the device will read
-  hal::byte m_gscale;
 };
 }  // namespace hal::stm_imu
@@ -14,92 +14,36 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
 #include <libhal-util/bit.hpp>
-#include <libhal-util/map.hpp>
-#include <libhal-util/serial.hpp>
 #include <libhal-util/spi.hpp>
 #include <libhal/accelerometer.hpp>
 #include <libhal/output_pin.hpp>
-#include <libhal/steady_clock.hpp>
-#include <libhal/timeout.hpp>
+#include <libhal/spi.hpp>
+
+#include "lis3dhtr_core.hpp"
 
 namespace hal::stm_imu {
-class lis3dhtr_spi : public hal::accelerometer
+/**
+ * @brief SPI transport for lis3dhtr_core
+ *
+ * Every transaction is framed by the chip select. The command byte holds the
+ * read bit (bit 7), the MS bit (bit 6) which enables auto-increment and the
+ * register address in bits 5:0.
+ *
+ * In 3-wire mode the device shares a single data line (SDI/SDO) for both
+ * directions. Commands and data are then always sent in a write transfer and
+ * data is received in a separate read transfer, so the SPI controller must be
+ * set up for half-duplex (bidirectional) operation by the application.
+ */
+class lis3dhtr_spi_transport
 {
 public:
-  /**
-   * @brief max_acceleration is the maxium g's that the device will read
-   * NOTE: the higher the max gravity you select, the lower your resolution is
-   */
-  enum class max_acceleration : hal::byte
-  {
-    /**
-     * @brief 2x the average earth gravity, acceleration
-     */
-    g2 = 0x00,
-    /**
-     * @brief 4x the average earth gravity, acceleration
-     */
-    g4 = 0x01,
-    /**
-     * @brief 8x the average earth gravity, acceleration
-     */
-    g8 = 0x02,
-    /**
-     * @brief 16x the average earth gravity, acceleration
-     */
-    g16 = 0x03,
-  };
-
-  /**
-   * @brief data_rate_config are the different data rates that the imu can be
-   * programmed to output data at in the different modes
-   */
-  enum class data_rate_config : hal::byte
-  {
-    /**
-     * @brief 0Hz (this is the power down command)
-     */
-    mode_0 = 0b0000,
-    /**
-     * @brief 1Hz
-     */
-    mode_1 = 0b0001,
-    /**
-     * @brief 10Hz
-     */
-    mode_2 = 0b0010,
-    /**
-     * @brief 25Hz
-     */
-    mode_3 = 0b0011,
-    /**
-     * @brief 50Hz
-     */
-    mode_4 = 0b0100,
-    /**
-     * @brief 100Hz
-     */
-    mode_5 = 0b0101,
-    /**
-     * @brief 200Hz
-     */
-    mode_6 = 0b0110,
-    /**
-     * @brief 400Hz
-     */
-    mode_7 = 0b0111,
-    /**
-     * @brief just low power mode is configured in this one to 1.6kHz
-     * this is also the default mode set by power_on
-     */
-    mode_8 = 0b1000,
-    /**
-     * @brief High resolution = normal = 1.344kHz; low power mode = 5.376kHz
-     */
-    mode_9 = 0b1001,
-  };
-
   /**
    * @brief spi_mode are the two different spi modes that the device supports
    */
@@ -116,78 +60,218 @@ public:
   };
 
   /**
-   * @brief Constructs lis object
-   *
+   * @brief Every transaction asserts the chip select once
+   */
+  static constexpr std::uint32_t chip_selects_per_transaction = 1;
+
+  /**
    * @param p_spi - spi bus the lis is connected to
    * @param p_cs - The chip select to choose this chip to read and write to
-   * @param p_gscale - The full scale setting for the imu, defaults to 2g
-   *
-   * @throws hal::no_such_device - when ID register does not match
-   * the expected ID for the lis3dhtr_spi device.
+   * @param p_spi_mode - how the data lines are wired to the device
    */
-  lis3dhtr_spi(spi& p_spi,
-               hal::output_pin& p_cs,
-               max_acceleration p_gscale = max_acceleration::g2);
+  lis3dhtr_spi_transport(hal::spi& p_spi,
+                         hal::output_pin& p_cs,
+                         spi_mode p_spi_mode = spi_mode::four_wire)
+    : m_spi(&p_spi)
+    , m_cs(&p_cs)
+    , m_spi_mode(p_spi_mode)
+  {
+  }
 
   /**
-   * @brief verify's that the device exists on the spi line
-   *
-   * @throws hal::no_such_device - when ID register does not match
-   * the expected ID for the lis3dhtr_spi device.
+   * @brief Returns the SIM bit of CTRL_REG4 matching the wire mode
    */
-  void verify_device();
+  hal::byte ctrl_reg4_bits() const
+  {
+    return static_cast<hal::byte>(m_spi_mode);
+  }
 
   /**
-   * @brief enables acceleration readings from the lis
+   * @brief Changes how transactions are framed on the data lines
+   *
+   * Does not change the device, see lis3dhtr_core::configure_spi_mode().
    *
+   * @param p_spi_mode - how the data lines are wired to the device
    */
-  void power_on();
+  void configure_spi_mode(spi_mode p_spi_mode)
+  {
+    m_spi_mode = p_spi_mode;
+  }
+
+  static constexpr hal::byte read_command(hal::byte p_register)
+  {
+    return hal::bit_value(0U)
+      .insert<address_bit_mask>(p_register)
+      .set<read_bit_mask>()
+      .set<address_increment_bit_mask>()
+      .to<hal::byte>();
+  }
+
+  static constexpr hal::byte write_command(hal::byte p_register)
+  {
+    return hal::bit_value(0U)
+      .insert<address_bit_mask>(p_register)
+      .set<address_increment_bit_mask>()
+      .to<hal::byte>();
+  }
 
   /**
-   * @brief Disables acceleration reading from the lis3dhtr_spi.
+   * @brief Performs one transaction with a single chip select assertion
    *
+   * In 4-wire mode, reads that fit in max_full_duplex_frame are clocked out in
+   * a single full-duplex transfer, which covers every sample and status read.
+   * Longer FIFO bursts, and every read in 3-wire mode, use a write transfer
+   * followed by a read transfer.
+   *
+   * @param p_data_out - command byte followed by any data to write
+   * @param p_data_in - buffer to fill with the data read after the command
    */
-  void power_off();
+  void transaction(std::span<hal::byte const> p_data_out,
+                   std::span<hal::byte> p_data_in)
+  {
+    auto const frame_size = p_data_out.size() + p_data_in.size();
+
+    m_cs->level(false);
+    if (p_data_in.empty()) {
+      hal::write(*m_spi, p_data_out);
+    } else if (m_spi_mode == spi_mode::four_wire &&
+               frame_size <= max_full_duplex_frame) {
+      // the bytes received while the command is shifted out are discarded
+      std::array<hal::byte, max_full_duplex_frame> buffer{};
+      auto const frame = std::span(buffer).first(frame_size);
+      m_spi->transfer(p_data_out, frame);
+      std::ranges::copy(frame.subspan(p_data_out.size()), p_data_in.begin());
+    } else {
+      hal::write_then_read(*m_spi, p_data_out, p_data_in);
+    }
+    m_cs->level(true);
+  }
+
+private:
+  /// Command byte, status register and one xyz sample
+  static constexpr std::size_t max_full_duplex_frame = 8;
+  // This is the bit mask to indicate a read on spi
+  static constexpr auto read_bit_mask = hal::bit_mask::from<7>();
+  // this is the bit mask to indicate a auto increment address on reads and
+  // writes
+  static constexpr auto address_increment_bit_mask = hal::bit_mask::from<6>();
+  // the register address occupies the remaining bits of the command byte
+  static constexpr auto address_bit_mask = hal::bit_mask::from<5, 0>();
 
   /**
-   * @brief Configures the frequency that new data can be read from the device
-   *
-   * @param p_data_rate - the frequency that new data can be read from the
-   * device
+   * @brief The spi peripheral used for communication with the device.
    */
-  void configure_data_rates(data_rate_config p_data_rate);
+  hal::spi* m_spi;
 
   /**
-   * @brief Changes the gravity scale that the lis is reading. The larger the
-   * scale, the less precise the reading.
-   *
-   * @param p_gravity_code - Scales in powers of 2 up to 16.
+   * @brief The chip select pin used to choose this device on the bus.
    */
-  void configure_full_scale(max_acceleration p_gravity_code);
+  hal::output_pin* m_cs;
 
-private:
-  accelerometer::read_t driver_read();
+  /**
+   * @brief How the data lines are wired to the device
+   */
+  spi_mode m_spi_mode;
+};
+
+/**
+ * @brief Non-virtual lis3dhtr driver over SPI
+ *
+ * Provides the same operations as lis3dhtr_spi, but read() is an inline
+ * member rather than an override of hal::accelerometer::driver_read(). Use it
+ * in tight loops where the call through the accelerometer interface would
+ * keep the sample conversion from being inlined.
+ */
+using lis3dhtr_spi_core = lis3dhtr_core<lis3dhtr_spi_transport>;
+
+/**
+ * @brief hal::accelerometer adapter over lis3dhtr_spi_core
+ */
+class lis3dhtr_spi
+  : public hal::accelerometer
+  , public lis3dhtr_core<lis3dhtr_spi_transport>
+{
+public:
+  /**
+   * @brief spi_mode are the two different spi modes that the device supports
+   */
+  using spi_mode = lis3dhtr_spi_transport::spi_mode;
 
   /**
-   * @brief Changes what spi wire mode that the device will use to transfer data
-   * 3 wire mode is not yet supported which is why this is locked to 4 wire mode
+   * @brief Constructs lis object
    *
-   * @param p_spi_mode - The spi mode that the device will use
+   * @param p_spi - spi bus the lis is connected to
+   * @param p_cs - The chip select to choose this chip to read and write to
+   * @param p_gscale - The full scale setting for the imu, defaults to 2g
+   *
+   * @throws hal::no_such_device - when ID register does not match
+   * the expected ID for the lis3dhtr_spi device.
    */
-  void configure_spi_mode(spi_mode p_spi_mode);
+  lis3dhtr_spi(spi& p_spi,
+               hal::output_pin& p_cs,
+               max_acceleration p_gscale = max_acceleration::g2);
 
   /**
-   * @brief The spi peripheral used for communication with the device.
+   * @brief Constructs lis object with a complete device configuration
+   *
+   * After verifying the device, CTRL_REG1 through CTRL_REG6 are written in a
+   * single burst, followed by FIFO_CTRL_REG.
+   *
+   * @param p_spi - spi bus the lis is connected to
+   * @param p_cs - The chip select to choose this chip to read and write to
+   * @param p_settings - the configuration to apply to the device
+   * @param p_spi_mode - how the data lines are wired to the device. In 3-wire
+   * mode the SIM bit is written before the device is verified, since the
+   * device does not drive the shared data line until it is set.
+   *
+   * @throws hal::no_such_device - when ID register does not match
+   * the expected ID for the lis3dhtr_spi device.
    */
-  hal::spi* m_spi;
+  lis3dhtr_spi(spi& p_spi,
+               hal::output_pin& p_cs,
+               settings const& p_settings,
+               spi_mode p_spi_mode = spi_mode::four_wire);
+
   /**
-   * @brief The output pin used to select the lis3dhtr on the spi bus
+   * @brief Constructs lis object without verifying the device
+   *
+   * Writes CTRL_REG1..6, SIM bit included, in one burst, followed by
+   * FIFO_CTRL_REG unless the FIFO is bypassed, and reads nothing back. Call
+   * device_present() or verify_device() later to confirm the device.
+   *
+   * @param p_spi - spi bus the lis is connected to
+   * @param p_cs - The chip select to choose this chip to read and write to
+   * @param p_settings - the configuration to apply to the device
+   * @param p_spi_mode - how the data lines are wired to the device
    */
-  hal::output_pin* m_cs;
+  lis3dhtr_spi(spi& p_spi,
+               hal::output_pin& p_cs,
+               settings const& p_settings,
+               spi_mode p_spi_mode,
+               fast_start_t);
 
   /**
-   * @brief The minimum and maxium g's that the device will read
+   * @brief Constructs lis object from the configuration the device already
+   * holds
+   *
+   * Used after an MCU reset to resume streaming without reconfiguring the
+   * device, which keeps the samples already in its FIFO. See
+   * lis3dhtr_core::adopt_configuration().
+   *
+   * @param p_spi - spi bus the lis is connected to
+   * @param p_cs - The chip select to choose this chip to read and write to
+   * @param p_spi_mode - how the data lines are wired to the device, must match
+   * the SIM bit the device holds
    */
-  hal::byte m_gscale;
+  lis3dhtr_spi(spi& p_spi,
+               hal::output_pin& p_cs,
+               spi_mode p_spi_mode,
+               warm_restart_t);
+
+  /// read() goes through hal::accelerometer, lis3dhtr_core::read() does not
+  using hal::accelerometer::read;
+
+private:
+  accelerometer::read_t driver_read() override;
 };
 }  // namespace hal::stm_imu
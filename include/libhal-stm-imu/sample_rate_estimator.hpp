@@ -0,0 +1,251 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include <libhal/units.hpp>
+
+namespace hal::stm_imu {
+/**
+ * @brief Estimates the device's true output data rate against a
+ * hal::steady_clock
+ *
+ * The device's internal oscillator deviates from the nominal data rate, so
+ * stamping samples with the nominal period accumulates error over long
+ * captures. Each FIFO drain gives one observation: the index of a sample
+ * counted since the capture began and the clock tick it was acquired at.
+ * A recursive least-squares fit of tick = offset + period * index over these
+ * observations yields the effective sample period and a drift corrected
+ * mapping from sample index to tick.
+ *
+ * Older observations are weighted down by forgetting_factor at each update,
+ * so the estimate follows slow drift such as temperature changes. The fit is
+ * kept relative to the latest observation, which keeps every value small
+ * enough for single precision floats. An update costs about 20 floating point
+ * operations.
+ */
+class sample_rate_estimator
+{
+public:
+  /**
+   * @brief settings for the sample rate estimator
+   */
+  struct settings
+  {
+    /**
+     * @brief Weight past observations keep at each update, closer to 1
+     * averages over more drains but follows drift more slowly
+     */
+    float forgetting_factor = 0.995f;
+    /**
+     * @brief Expected deviation of the true rate from the nominal rate as a
+     * fraction of the nominal rate
+     */
+    float rate_tolerance = 0.05f;
+  };
+
+  /**
+   * @brief Constructs the estimator with the default settings
+   *
+   * @param p_nominal_rate - the data rate the device is configured for
+   * @param p_clock_frequency - frequency of the clock observations are
+   * measured with
+   */
+  sample_rate_estimator(hal::hertz p_nominal_rate,
+                        hal::hertz p_clock_frequency)
+    : sample_rate_estimator(p_nominal_rate, p_clock_frequency, settings{})
+  {
+  }
+
+  /**
+   * @brief Constructs the estimator
+   *
+   * @param p_nominal_rate - the data rate the device is configured for
+   * @param p_clock_frequency - frequency of the clock observations are
+   * measured with
+   * @param p_settings - forgetting factor and initial rate tolerance
+   */
+  sample_rate_estimator(hal::hertz p_nominal_rate,
+                        hal::hertz p_clock_frequency,
+                        settings const& p_settings)
+    : m_settings(p_settings)
+    , m_clock_frequency(p_clock_frequency)
+    , m_nominal_rate(p_nominal_rate)
+    , m_period(p_clock_frequency / p_nominal_rate)
+    // covariances are relative to the variance of an observation that is
+    // uniformly spread over one sample period, which is period^2 / 12
+    , m_period_variance(12.0f * p_settings.rate_tolerance *
+                        p_settings.rate_tolerance)
+  {
+  }
+
+  /**
+   * @brief Records that sample p_sample_index was acquired at p_ticks
+   *
+   * @param p_sample_index - index of the sample counted from the start of the
+   * capture, must not decrease between updates
+   * @param p_ticks - clock uptime at which the sample was acquired
+   */
+  void update(std::uint64_t p_sample_index, std::uint64_t p_ticks)
+  {
+    m_updates++;
+
+    if (not m_anchored) {
+      m_anchored = true;
+      m_origin_index = p_sample_index;
+      m_origin_ticks = p_ticks;
+      m_offset = 0.0f;
+      m_offset_variance = 1.0f;
+      m_covariance = 0.0f;
+      return;
+    }
+
+    // move the origin of the fit to this sample
+    auto const distance = static_cast<float>(p_sample_index - m_origin_index);
+    m_offset += m_period * distance;
+    m_offset_variance += distance * (2.0f * m_covariance +
+                                     distance * m_period_variance);
+    m_covariance += distance * m_period_variance;
+
+    // measure the tick relative to this observation, the residual is what
+    // the fit predicted beyond it
+    m_offset -= static_cast<float>(
+      static_cast<std::int64_t>(p_ticks - m_origin_ticks));
+    m_origin_index = p_sample_index;
+    m_origin_ticks = p_ticks;
+
+    auto const lambda = m_settings.forgetting_factor;
+    auto const error = -m_offset;
+    auto const denominator = lambda + m_offset_variance;
+    auto const offset_gain = m_offset_variance / denominator;
+    auto const period_gain = m_covariance / denominator;
+
+    m_offset += offset_gain * error;
+    m_period += period_gain * error;
+
+    auto const offset_variance = m_offset_variance;
+    auto const covariance = m_covariance;
+    m_offset_variance = (offset_variance - offset_gain * offset_variance) /
+                        lambda;
+    m_covariance = (covariance - offset_gain * covariance) / lambda;
+    m_period_variance = (m_period_variance - period_gain * covariance) /
+                        lambda;
+  }
+
+  /**
+   * @brief Forgets where the samples are in time but keeps the period
+   *
+   * Call this when samples may have been lost, such as after a FIFO overrun,
+   * so the sample index no longer counts every acquired sample. The next
+   * update anchors the fit again.
+   */
+  void resynchronize()
+  {
+    m_anchored = false;
+  }
+
+  /**
+   * @brief Returns the estimated acquisition tick of a sample
+   *
+   * @param p_sample_index - index of the sample counted from the start of the
+   * capture
+   * @return std::uint64_t - clock uptime at which the sample was acquired,
+   * meaningless before the first update
+   */
+  [[nodiscard]] std::uint64_t ticks(std::uint64_t p_sample_index) const
+  {
+    auto const distance = static_cast<float>(
+      static_cast<std::int64_t>(p_sample_index - m_origin_index));
+    auto const offset = std::llround(m_offset + m_period * distance);
+    return m_origin_ticks + static_cast<std::uint64_t>(offset);
+  }
+
+  /**
+   * @brief Returns the estimated clock ticks between consecutive samples
+   */
+  [[nodiscard]] float ticks_per_sample() const
+  {
+    return m_period;
+  }
+
+  /**
+   * @brief Returns the estimated output data rate
+   */
+  [[nodiscard]] hal::hertz sample_rate() const
+  {
+    return m_clock_frequency / m_period;
+  }
+
+  /**
+   * @brief Returns how far the estimated rate is from the nominal rate, as a
+   * fraction of the nominal rate
+   */
+  [[nodiscard]] float drift() const
+  {
+    return sample_rate() / m_nominal_rate - 1.0f;
+  }
+
+  /**
+   * @brief Returns the index the next sample read from the device receives
+   */
+  [[nodiscard]] std::uint64_t next_index() const
+  {
+    return m_next_index;
+  }
+
+  /**
+   * @brief Counts samples read from the device
+   *
+   * @param p_count - the number of samples read
+   */
+  void advance(std::size_t p_count)
+  {
+    m_next_index += p_count;
+  }
+
+  /**
+   * @brief Returns the number of observations recorded
+   */
+  [[nodiscard]] std::size_t updates() const
+  {
+    return m_updates;
+  }
+
+private:
+  settings m_settings;
+  hal::hertz m_clock_frequency;
+  hal::hertz m_nominal_rate;
+  /// Index of the sample the fit is currently relative to
+  std::uint64_t m_origin_index = 0;
+  /// Observed tick of the sample at m_origin_index
+  std::uint64_t m_origin_ticks = 0;
+  /// Fitted tick of the sample at m_origin_index minus m_origin_ticks
+  float m_offset = 0.0f;
+  /// Fitted ticks per sample
+  float m_period;
+  /// Relative variance of m_offset
+  float m_offset_variance = 1.0f;
+  /// Relative covariance of m_offset and m_period
+  float m_covariance = 0.0f;
+  /// Relative variance of m_period
+  float m_period_variance;
+  std::uint64_t m_next_index = 0;
+  std::size_t m_updates = 0;
+  bool m_anchored = false;
+};
+}  // namespace hal::stm_imu
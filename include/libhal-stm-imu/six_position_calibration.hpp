@@ -0,0 +1,270 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "lis3dhtr_core.hpp"
+#include "streaming_statistics.hpp"
+
+namespace hal::stm_imu {
+/**
+ * @brief Measures a lis3dhtr::calibration_model from six stationary captures
+ *
+ * The device is held still with each axis in turn pointing up and then down,
+ * so gravity is the only acceleration and each axis reads +1g and -1g once.
+ * The orientation of a capture is recognized from the samples, so the six
+ * positions can be captured in any order, and a position captured again is
+ * averaged with the earlier captures.
+ *
+ * Captures must be raw samples read without a calibration, such as from
+ * lis3dhtr_core::read_fifo() or read_raw().
+ */
+class six_position_calibration
+{
+public:
+  /**
+   * @brief The orientations by the axis that reads gravity and its sign
+   */
+  enum class orientation : std::uint8_t
+  {
+    x_positive,
+    x_negative,
+    y_positive,
+    y_negative,
+    z_positive,
+    z_negative,
+  };
+
+  /**
+   * @param p_max_deviation - the largest standard deviation of an axis in g's
+   * for a capture to count as stationary
+   */
+  explicit six_position_calibration(float p_max_deviation = 0.02f)
+    : m_max_deviation(p_max_deviation)
+  {
+  }
+
+  /**
+   * @brief Adds the samples of one stationary capture
+   *
+   * @param p_samples - raw samples captured in a single position, with the
+   * same full scale and resolution
+   * @return true - the capture was recognized and recorded. false if it held
+   * fewer than two samples, the device moved, no axis was aligned with
+   * gravity or the full scale changed during the capture.
+   */
+  bool add_capture(std::span<lis3dhtr::raw_read_t const> p_samples)
+  {
+    if (p_samples.size() < 2) {
+      return false;
+    }
+
+    welford_accumulator capture;
+    for (auto const& sample : p_samples) {
+      if (sample.full_scale != p_samples[0].full_scale ||
+          sample.resolution != p_samples[0].resolution) {
+        return false;
+      }
+      capture.add(sample);
+    }
+
+    auto const g_per_digit =
+      lis3dhtr::milli_g_per_digit(p_samples[0].full_scale,
+                                  p_samples[0].resolution) /
+      1000.0f;
+    auto const count = static_cast<float>(capture.count());
+
+    std::array<float, 3> mean{};
+    std::size_t vertical = 0;
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      auto const& moments = capture.axis(axis);
+      auto const deviation =
+        std::sqrt(moments.m2 / (count - 1.0f)) * g_per_digit;
+      if (deviation > m_max_deviation) {
+        return false;
+      }
+      mean[axis] = moments.mean * g_per_digit;
+      if (std::abs(mean[axis]) > std::abs(mean[vertical])) {
+        vertical = axis;
+      }
+    }
+
+    // gravity must be on one axis, within roughly 17 degrees
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      auto const expected = axis == vertical ? 1.0f : 0.0f;
+      if (std::abs(std::abs(mean[axis]) - expected) > 0.3f) {
+        return false;
+      }
+    }
+
+    auto const index = 2 * vertical + (mean[vertical] < 0.0f ? 1 : 0);
+    auto& position = m_positions[index];
+    auto const total = position.samples + capture.count();
+    auto const weight = count / static_cast<float>(total);
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      position.mean[axis] += (mean[axis] - position.mean[axis]) * weight;
+    }
+    position.samples = total;
+    return true;
+  }
+
+  /**
+   * @param p_orientation - the orientation to check
+   * @return true - at least one capture in the orientation was recorded
+   */
+  [[nodiscard]] bool captured(orientation p_orientation) const
+  {
+    return m_positions[static_cast<std::size_t>(p_orientation)].samples > 0;
+  }
+
+  /**
+   * @return true - every orientation has been captured
+   */
+  [[nodiscard]] bool complete() const
+  {
+    for (auto const& position : m_positions) {
+      if (position.samples == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Computes the calibration from the captured orientations
+   *
+   * The bias is the average reading of all six positions, in which gravity
+   * cancels. The scale of an axis is set by the difference between its up
+   * and down readings. With p_cross_axis the readings of the other axes in
+   * those positions give the matrix that removes the coupling between axes.
+   *
+   * The cross axis matrix is the inverse of the response of the axes to
+   * gravity, normalized to 1 on its diagonal. An aligned device has a
+   * determinant near 1. Below min_determinant the response is close enough
+   * to singular that small errors in the captures swing the inverse, which
+   * points at bad captures rather than a real device, and no calibration is
+   * returned.
+   *
+   * @param p_cross_axis - also compute the cross axis matrix, which costs 9
+   * multiplies per converted sample instead of 3
+   * @return std::optional<lis3dhtr::calibration_model> - the calibration, or
+   * std::nullopt if not every orientation has been captured or the response
+   * is too close to singular to invert
+   */
+  [[nodiscard]] std::optional<lis3dhtr::calibration_model> compute(
+    bool p_cross_axis = false) const
+  {
+    if (not complete()) {
+      return std::nullopt;
+    }
+
+    lis3dhtr::calibration_model model{};
+
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      float sum = 0.0f;
+      for (auto const& position : m_positions) {
+        sum += position.mean[axis];
+      }
+      model.bias[axis] = sum / 6.0f;
+    }
+
+    // column i is the response to 1g along axis i
+    std::array<std::array<float, 3>, 3> response{};
+    for (std::size_t column = 0; column < 3; column++) {
+      auto const& up = m_positions[2 * column].mean;
+      auto const& down = m_positions[2 * column + 1].mean;
+      for (std::size_t row = 0; row < 3; row++) {
+        response[row][column] = (up[row] - down[row]) / 2.0f;
+      }
+      model.scale[column] = 1.0f / response[column][column];
+    }
+
+    if (p_cross_axis) {
+      for (std::size_t row = 0; row < 3; row++) {
+        for (std::size_t column = 0; column < 3; column++) {
+          response[row][column] *= model.scale[row];
+        }
+      }
+      auto const inverse = invert(response);
+      if (not inverse) {
+        return std::nullopt;
+      }
+      model.cross_axis = *inverse;
+    }
+    return model;
+  }
+
+  /**
+   * @brief Forgets every capture
+   */
+  void reset()
+  {
+    m_positions = {};
+  }
+
+  /**
+   * @brief The smallest determinant of the normalized response that compute()
+   * inverts
+   */
+  static constexpr float min_determinant = 0.5f;
+
+private:
+  using matrix = std::array<std::array<float, 3>, 3>;
+
+  struct position_state
+  {
+    /// average reading in g's
+    std::array<float, 3> mean{};
+    std::uint32_t samples = 0;
+  };
+
+  static std::optional<matrix> invert(matrix const& p_matrix)
+  {
+    auto const& m = p_matrix;
+    auto const cofactor = [&m](std::size_t p_row, std::size_t p_column) {
+      auto const r0 = (p_row + 1) % 3;
+      auto const r1 = (p_row + 2) % 3;
+      auto const c0 = (p_column + 1) % 3;
+      auto const c1 = (p_column + 2) % 3;
+      return m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+    };
+
+    auto const determinant = m[0][0] * cofactor(0, 0) +
+                             m[0][1] * cofactor(0, 1) +
+                             m[0][2] * cofactor(0, 2);
+    if (not(std::abs(determinant) >= min_determinant)) {
+      return std::nullopt;
+    }
+
+    matrix inverse{};
+    for (std::size_t row = 0; row < 3; row++) {
+      for (std::size_t column = 0; column < 3; column++) {
+        // the inverse is the transposed cofactor matrix over the determinant
+        inverse[row][column] = cofactor(column, row) / determinant;
+      }
+    }
+    return inverse;
+  }
+
+  std::array<position_state, 6> m_positions{};
+  float m_max_deviation;
+};
+}  // namespace hal::stm_imu
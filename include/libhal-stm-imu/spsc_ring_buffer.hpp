@@ -0,0 +1,197 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <span>
+
+namespace hal::stm_imu {
+/**
+ * @brief Alignment that keeps the producer's and consumer's indexes on
+ * separate cache lines
+ *
+ * Only applied on hosted builds, where the two sides run on different cores
+ * and sharing a line makes every push and pop bounce it between them.
+ * Microcontrollers run both sides on one core, so the padding would only cost
+ * RAM.
+ */
+#if defined(__linux__) || defined(__APPLE__) || defined(_WIN32)
+inline constexpr std::size_t spsc_index_alignment = 64;
+#else
+inline constexpr std::size_t spsc_index_alignment =
+  alignof(std::atomic<std::size_t>);
+#endif
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring buffer
+ *
+ * Intended to hand samples from an interrupt handler (the producer) to a
+ * task (the consumer) without disabling interrupts or allocating. Only one
+ * context may call push() and only one context may call pop_batch().
+ *
+ * The head and tail are free running counters masked down to an index, so
+ * the storage is used in power of two sized pieces and every slot of it can
+ * hold an element.
+ *
+ * @tparam T - the type of element held by the buffer
+ */
+template<typename T>
+class spsc_ring_buffer
+{
+public:
+  /**
+   * @brief Constructs a ring buffer with no storage, push() always fails
+   * until storage is assigned
+   */
+  spsc_ring_buffer() = default;
+
+  /**
+   * @brief Constructs a ring buffer on top of caller provided storage
+   *
+   * @param p_storage - storage for the elements. Only the largest power of two
+   * number of elements that fits in the storage is used.
+   */
+  explicit spsc_ring_buffer(std::span<T> p_storage)
+  {
+    assign(p_storage);
+  }
+
+  spsc_ring_buffer(spsc_ring_buffer const&) = delete;
+  spsc_ring_buffer& operator=(spsc_ring_buffer const&) = delete;
+
+  /**
+   * @brief Replaces the storage and empties the buffer
+   *
+   * Neither the producer nor the consumer may be running during this call.
+   *
+   * @param p_storage - storage for the elements. Only the largest power of two
+   * number of elements that fits in the storage is used.
+   */
+  void assign(std::span<T> p_storage)
+  {
+    m_storage = p_storage.first(std::bit_floor(p_storage.size()));
+    m_mask = m_storage.empty() ? 0 : m_storage.size() - 1;
+    m_producer.cached_head = 0;
+    m_consumer.cached_tail = 0;
+    m_consumer.head.store(0, std::memory_order_relaxed);
+    m_producer.tail.store(0, std::memory_order_release);
+  }
+
+  /**
+   * @brief Appends an element, producer side only
+   *
+   * @param p_value - the element to append
+   * @return true - the element was appended
+   * @return false - the buffer is full and the element was dropped
+   */
+  bool push(T const& p_value)
+  {
+    auto const tail = m_producer.tail.load(std::memory_order_relaxed);
+    if (tail - m_producer.cached_head == m_storage.size()) {
+      // only look at the consumer's index when the buffer seems full
+      m_producer.cached_head =
+        m_consumer.head.load(std::memory_order_acquire);
+      if (tail - m_producer.cached_head == m_storage.size()) {
+        return false;
+      }
+    }
+    m_storage[tail & m_mask] = p_value;
+    m_producer.tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Removes as many elements as fit in p_values, consumer side only
+   *
+   * The producer's index is acquired once and the consumer's index released
+   * once per call, however many elements are removed, and the elements are
+   * copied in at most two contiguous runs.
+   *
+   * @param p_values - destination for the elements, oldest element first
+   * @return std::span<T> - the portion of p_values that was filled
+   */
+  std::span<T> pop_batch(std::span<T> p_values)
+  {
+    auto const head = m_consumer.head.load(std::memory_order_relaxed);
+    if (m_consumer.cached_tail - head < p_values.size()) {
+      // only look at the producer's index when the known elements run short
+      m_consumer.cached_tail =
+        m_producer.tail.load(std::memory_order_acquire);
+    }
+
+    auto const count =
+      std::min<std::size_t>(m_consumer.cached_tail - head, p_values.size());
+    if (count == 0) {
+      return p_values.first(0);
+    }
+
+    auto const first = head & m_mask;
+    auto const first_run = std::min(count, m_storage.size() - first);
+    std::copy_n(m_storage.begin() + first, first_run, p_values.begin());
+    std::copy_n(
+      m_storage.begin(), count - first_run, p_values.begin() + first_run);
+
+    m_consumer.head.store(head + count, std::memory_order_release);
+    return p_values.first(count);
+  }
+
+  /**
+   * @brief Returns the number of elements currently held
+   *
+   * The value is only a snapshot when called while the other side is active.
+   */
+  [[nodiscard]] std::size_t size() const
+  {
+    auto const head = m_consumer.head.load(std::memory_order_acquire);
+    auto const tail = m_producer.tail.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  /**
+   * @brief Returns the maximum number of elements the buffer can hold
+   */
+  [[nodiscard]] std::size_t capacity() const
+  {
+    return m_storage.size();
+  }
+
+private:
+  /// State written by the producer
+  struct alignas(spsc_index_alignment) producer_state
+  {
+    /// Count of elements ever pushed
+    std::atomic<std::size_t> tail = 0;
+    /// Last head seen by the producer, never ahead of the real head
+    std::size_t cached_head = 0;
+  };
+
+  /// State written by the consumer
+  struct alignas(spsc_index_alignment) consumer_state
+  {
+    /// Count of elements ever popped
+    std::atomic<std::size_t> head = 0;
+    /// Last tail seen by the consumer, never ahead of the real tail
+    std::size_t cached_tail = 0;
+  };
+
+  std::span<T> m_storage{};
+  std::size_t m_mask = 0;
+  producer_state m_producer{};
+  consumer_state m_consumer{};
+};
+}  // namespace hal::stm_imu
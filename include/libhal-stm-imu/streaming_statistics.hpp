@@ -0,0 +1,378 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "lis3dhtr_core.hpp"
+
+namespace hal::stm_imu {
+/**
+ * @brief Running mean, variance and extremes of raw samples per axis
+ *
+ * Uses Welford's update, which stays accurate when the variance is small
+ * compared to the mean, such as vibration riding on gravity. Two
+ * accumulators can be combined with merge(), which gives the same result as
+ * feeding both sets of samples into one. The co-moments between axes are
+ * kept too, so the variance of any linear combination of the axes, such as a
+ * calibrated axis, can be computed.
+ */
+class welford_accumulator
+{
+public:
+  /**
+   * @brief Moments of one axis in digits
+   */
+  struct moments
+  {
+    float mean = 0.0f;
+    /// sum of squared differences from the mean
+    float m2 = 0.0f;
+    std::int16_t min = INT16_MAX;
+    std::int16_t max = INT16_MIN;
+  };
+
+  /**
+   * @brief Adds one sample to the moments of every axis
+   *
+   * @param p_sample - raw sample from the driver
+   */
+  void add(lis3dhtr::raw_read_t const& p_sample)
+  {
+    m_count++;
+    auto const weight = 1.0f / static_cast<float>(m_count);
+    std::array<std::int16_t, 3> const values{ p_sample.x,
+                                              p_sample.y,
+                                              p_sample.z };
+    std::array<float, 3> delta{};
+    for (std::size_t i = 0; i < 3; i++) {
+      auto& axis = m_axes[i];
+      auto const value = static_cast<float>(values[i]);
+      delta[i] = value - axis.mean;
+      axis.mean += delta[i] * weight;
+      axis.m2 += delta[i] * (value - axis.mean);
+      axis.min = std::min(axis.min, values[i]);
+      axis.max = std::max(axis.max, values[i]);
+    }
+    for (std::size_t pair = 0; pair < 3; pair++) {
+      auto const [row, column] = pairs[pair];
+      m_co_m2[pair] +=
+        delta[row] * (static_cast<float>(values[column]) - m_axes[column].mean);
+    }
+  }
+
+  /**
+   * @brief Combines the samples of p_other into this accumulator
+   *
+   * @param p_other - accumulator over a disjoint set of samples
+   */
+  void merge(welford_accumulator const& p_other)
+  {
+    if (p_other.m_count == 0) {
+      return;
+    }
+    auto const count = m_count + p_other.m_count;
+    auto const weight =
+      static_cast<float>(p_other.m_count) / static_cast<float>(count);
+    auto const cross = static_cast<float>(m_count) * weight;
+    std::array<float, 3> delta{};
+    for (std::size_t i = 0; i < 3; i++) {
+      delta[i] = p_other.m_axes[i].mean - m_axes[i].mean;
+    }
+    for (std::size_t pair = 0; pair < 3; pair++) {
+      auto const [row, column] = pairs[pair];
+      m_co_m2[pair] +=
+        p_other.m_co_m2[pair] + delta[row] * delta[column] * cross;
+    }
+    for (std::size_t i = 0; i < 3; i++) {
+      auto& axis = m_axes[i];
+      auto const& other = p_other.m_axes[i];
+      axis.mean += delta[i] * weight;
+      axis.m2 += other.m2 + delta[i] * delta[i] * cross;
+      axis.min = std::min(axis.min, other.min);
+      axis.max = std::max(axis.max, other.max);
+    }
+    m_count = count;
+  }
+
+  /**
+   * @brief Forgets every sample
+   */
+  void reset()
+  {
+    *this = welford_accumulator{};
+  }
+
+  /**
+   * @return std::uint32_t - the number of samples added
+   */
+  [[nodiscard]] std::uint32_t count() const
+  {
+    return m_count;
+  }
+
+  /**
+   * @param p_axis - 0 for x, 1 for y and 2 for z
+   * @return moments const& - the moments of the axis in digits
+   */
+  [[nodiscard]] moments const& axis(std::size_t p_axis) const
+  {
+    return m_axes[p_axis];
+  }
+
+  /**
+   * @param p_row - 0 for x, 1 for y and 2 for z
+   * @param p_column - 0 for x, 1 for y and 2 for z
+   * @return float - sum of the products of the differences of both axes from
+   * their means in digits squared, axis(p_row).m2 when both are the same
+   */
+  [[nodiscard]] float co_moment(std::size_t p_row, std::size_t p_column) const
+  {
+    if (p_row == p_column) {
+      return m_axes[p_row].m2;
+    }
+    for (std::size_t pair = 0; pair < 3; pair++) {
+      auto const [row, column] = pairs[pair];
+      if ((row == p_row && column == p_column) ||
+          (row == p_column && column == p_row)) {
+        return m_co_m2[pair];
+      }
+    }
+    return 0.0f;
+  }
+
+private:
+  /// the axes of each co-moment in m_co_m2
+  static constexpr std::array<std::array<std::size_t, 2>, 3> pairs{ {
+    { 0, 1 },
+    { 0, 2 },
+    { 1, 2 },
+  } };
+
+  std::array<moments, 3> m_axes{};
+  /// co-moments of xy, xz and yz
+  std::array<float, 3> m_co_m2{};
+  std::uint32_t m_count = 0;
+};
+
+/**
+ * @brief Per axis statistics over tumbling or sliding windows of raw samples
+ *
+ * Samples are accumulated in blocks of a fixed number of samples. The window
+ * covers the last Blocks completed blocks and moves by one block each time a
+ * block completes. With one block the windows are tumbling, with more they
+ * slide, and memory stays a welford_accumulator per block no matter how long
+ * the window is.
+ *
+ * The moments are kept in digits, so a change of full scale or resolution
+ * between samples starts a new window. Results are converted to g's with the
+ * sensitivity of the samples in the window, which is the sensitivity the
+ * driver used when it read them, and the calibration given to
+ * configure_calibration(). The mean, variance and rms are exact under any
+ * calibration. The extremes are tracked per axis in digits, so they only
+ * take the scale and offset of their own axis and ignore cross axis
+ * coupling.
+ *
+ * @tparam Blocks - the number of blocks in the window
+ */
+template<std::size_t Blocks = 1>
+class streaming_statistics
+{
+public:
+  static_assert(Blocks >= 1);
+
+  /**
+   * @brief Statistics of one axis in g's
+   */
+  struct axis_t
+  {
+    float mean;
+    /// unbiased sample variance in g's squared
+    float variance;
+    float rms;
+    float min;
+    float max;
+  };
+
+  /**
+   * @brief Statistics of every axis over the window
+   */
+  struct statistics_t
+  {
+    axis_t x;
+    axis_t y;
+    axis_t z;
+    /// the number of samples in the window
+    std::uint32_t count;
+  };
+
+  /**
+   * @param p_block_size - samples per block, the window moves by this many
+   * samples
+   */
+  explicit streaming_statistics(std::uint32_t p_block_size)
+    : m_block_size(std::max<std::uint32_t>(p_block_size, 1))
+  {
+  }
+
+  /**
+   * @brief Adds one sample
+   *
+   * @param p_sample - raw sample from the driver
+   * @return true - the sample completed a block and the window moved
+   */
+  bool add(lis3dhtr::raw_read_t const& p_sample)
+  {
+    if (p_sample.full_scale != m_full_scale ||
+        p_sample.resolution != m_resolution) {
+      reset();
+      m_full_scale = p_sample.full_scale;
+      m_resolution = p_sample.resolution;
+    }
+
+    m_current.add(p_sample);
+    if (m_current.count() < m_block_size) {
+      return false;
+    }
+
+    m_blocks[m_next_block] = m_current;
+    m_next_block = (m_next_block + 1) % Blocks;
+    m_completed_blocks = std::min(m_completed_blocks + 1, Blocks);
+    m_current.reset();
+    return true;
+  }
+
+  /**
+   * @brief Adds a block of samples, such as a FIFO burst
+   *
+   * @param p_samples - raw samples in the order they were acquired
+   * @return std::size_t - the number of times the window moved
+   */
+  std::size_t add(std::span<lis3dhtr::raw_read_t const> p_samples)
+  {
+    std::size_t moves = 0;
+    for (auto const& sample : p_samples) {
+      moves += add(sample) ? 1 : 0;
+    }
+    return moves;
+  }
+
+  /**
+   * @brief Returns true once the window covers Blocks blocks
+   */
+  [[nodiscard]] bool window_full() const
+  {
+    return m_completed_blocks == Blocks;
+  }
+
+  /**
+   * @brief Computes the statistics of the completed blocks in the window
+   *
+   * Samples of the block in progress are not included. Before the first
+   * block completes every statistic is zero.
+   *
+   * @return statistics_t - statistics in g's
+   */
+  [[nodiscard]] statistics_t statistics() const
+  {
+    welford_accumulator window;
+    for (std::size_t i = 0; i < m_completed_blocks; i++) {
+      window.merge(m_blocks[i]);
+    }
+
+    auto const conversion =
+      lis3dhtr::conversion_for(m_calibration, m_full_scale, m_resolution);
+    auto const mean = lis3dhtr::convert(std::array{ window.axis(0).mean,
+                                                    window.axis(1).mean,
+                                                    window.axis(2).mean },
+                                        conversion);
+    auto const convert = [&window, &conversion](std::size_t p_row,
+                                                float p_mean) {
+      if (window.count() == 0) {
+        return axis_t{};
+      }
+      // the calibrated axis is a weighted sum of the axes in digits
+      auto const& gain = conversion.gain[p_row];
+      float m2 = 0.0f;
+      for (std::size_t j = 0; j < 3; j++) {
+        for (std::size_t k = 0; k < 3; k++) {
+          m2 += gain[j] * gain[k] * window.co_moment(j, k);
+        }
+      }
+      auto const count = static_cast<float>(window.count());
+      auto const mean_square = p_mean * p_mean + m2 / count;
+      auto const variance = window.count() > 1 ? m2 / (count - 1.0f) : 0.0f;
+      auto const& moments = window.axis(p_row);
+      auto const offset = conversion.offset[p_row];
+      auto const low = gain[p_row] * moments.min + offset;
+      auto const high = gain[p_row] * moments.max + offset;
+      return axis_t{
+        .mean = p_mean,
+        .variance = variance,
+        .rms = std::sqrt(std::max(mean_square, 0.0f)),
+        .min = std::min(low, high),
+        .max = std::max(low, high),
+      };
+    };
+
+    return statistics_t{
+      .x = convert(0, mean.x),
+      .y = convert(1, mean.y),
+      .z = convert(2, mean.z),
+      .count = window.count(),
+    };
+  }
+
+  /**
+   * @brief Applies a calibration to the statistics
+   *
+   * Takes effect on the next call to statistics(), including for the
+   * samples already in the window.
+   *
+   * @param p_calibration - the model to apply, usually
+   * lis3dhtr_core::calibration() of the driver the samples come from. A
+   * default constructed model removes the calibration.
+   */
+  void configure_calibration(lis3dhtr::calibration_model const& p_calibration)
+  {
+    m_calibration = p_calibration;
+  }
+
+  /**
+   * @brief Empties the window and the block in progress
+   */
+  void reset()
+  {
+    m_current.reset();
+    m_completed_blocks = 0;
+    m_next_block = 0;
+  }
+
+private:
+  std::array<welford_accumulator, Blocks> m_blocks{};
+  welford_accumulator m_current{};
+  std::uint32_t m_block_size;
+  std::size_t m_completed_blocks = 0;
+  std::size_t m_next_block = 0;
+  lis3dhtr::max_acceleration m_full_scale = lis3dhtr::max_acceleration::g2;
+  hal::byte m_resolution = 0;
+  lis3dhtr::calibration_model m_calibration{};
+};
+}  // namespace hal::stm_imu
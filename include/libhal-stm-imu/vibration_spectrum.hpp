@@ -0,0 +1,667 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include <libhal/units.hpp>
+
+#include "lis3dhtr_core.hpp"
+
+namespace hal::stm_imu {
+namespace detail {
+struct unit_root_t
+{
+  double cos;
+  double sin;
+};
+
+/**
+ * @brief cos and sin of 2*pi*k/n for constant tables, since <cmath> is not
+ * constexpr in C++20
+ */
+constexpr unit_root_t unit_root(std::size_t p_k, std::size_t p_n)
+{
+  constexpr auto pi = std::numbers::pi;
+  auto x = 2.0 * pi * static_cast<double>(p_k % p_n) / static_cast<double>(p_n);
+  if (x > pi) {
+    x -= 2.0 * pi;
+  }
+
+  // 20 terms of the Taylor series are exact to double precision on [-pi, pi]
+  unit_root_t root{ .cos = 0.0, .sin = 0.0 };
+  auto cos_term = 1.0;
+  auto sin_term = x;
+  for (int i = 0; i < 20; i++) {
+    root.cos += cos_term;
+    root.sin += sin_term;
+    cos_term *= -x * x / ((2.0 * i + 1.0) * (2.0 * i + 2.0));
+    sin_term *= -x * x / ((2.0 * i + 2.0) * (2.0 * i + 3.0));
+  }
+  return root;
+}
+
+/// converts a value in [-1, 1] to float or Q15, saturating at +1
+template<typename Sample>
+constexpr Sample to_sample(double p_value)
+{
+  if constexpr (std::same_as<Sample, float>) {
+    return static_cast<float>(p_value);
+  } else {
+    auto const scaled = p_value * 32768.0;
+    auto const rounded = static_cast<std::int32_t>(
+      scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+    return static_cast<std::int16_t>(std::clamp(rounded, -32768, 32767));
+  }
+}
+}  // namespace detail
+
+/**
+ * @brief How real_fft stores its complex working data
+ */
+enum class fft_layout : hal::byte
+{
+  /// real and imaginary parts alternate, the layout of std::complex arrays
+  interleaved,
+  /// all real parts followed by all imaginary parts, with twiddles stored
+  /// per stage so every butterfly loop walks memory with unit stride, which
+  /// compilers can vectorize. Whether that beats interleaved depends on the
+  /// target and compiler, benchmarks/fft_layouts compares the two.
+  split,
+};
+
+/**
+ * @brief In-place radix-2 FFT of a real sequence
+ *
+ * The Points real samples are packed into Points / 2 complex samples, which
+ * are transformed with a decimation in time FFT and then split into the
+ * Points / 2 + 1 bins of the real spectrum. All twiddle factors are constant
+ * tables, nothing is allocated and the only working memory is the Points
+ * samples themselves.
+ *
+ * With std::int16_t samples the transform runs in Q15 fixed point and halves
+ * the data at every stage, so the bins are scaled by 1 / Points and the
+ * input must stay within +/-16384 to leave headroom for the complex packing.
+ *
+ * @tparam Points - transform length, a power of two such as 256, 512 or 1024
+ * @tparam Sample - float or std::int16_t for Q15
+ * @tparam Layout - storage of the complex working data
+ */
+template<std::size_t Points,
+         typename Sample = float,
+         fft_layout Layout = fft_layout::split>
+  requires(std::same_as<Sample, float> || std::same_as<Sample, std::int16_t>)
+class real_fft
+{
+public:
+  static_assert(std::has_single_bit(Points) && Points >= 8);
+
+  /**
+   * @brief The number of bins from DC to the Nyquist frequency
+   */
+  static constexpr std::size_t bins = Points / 2 + 1;
+
+  /**
+   * @brief Stores one input sample
+   *
+   * @param p_index - position in the sequence, less than Points
+   * @param p_value - the sample
+   */
+  void set(std::size_t p_index, Sample p_value)
+  {
+    auto const complex_index = p_index / 2;
+    if (p_index % 2 == 0) {
+      real(complex_index) = p_value;
+    } else {
+      imag(complex_index) = p_value;
+    }
+  }
+
+  /**
+   * @brief Transforms the stored samples into their spectrum, in place
+   */
+  void transform()
+  {
+    bit_reverse();
+    butterflies();
+    split();
+  }
+
+  /**
+   * @brief Returns the magnitude of one bin after transform()
+   *
+   * @param p_bin - bin index, less than bins
+   * @return float - the magnitude in units of the input. Q15 transforms are
+   * scaled back up by Points.
+   */
+  [[nodiscard]] float magnitude(std::size_t p_bin) const
+  {
+    auto const [real_part, imag_part] = parts(p_bin);
+    auto const magnitude =
+      std::sqrt(real_part * real_part + imag_part * imag_part);
+    if constexpr (q15) {
+      return magnitude * static_cast<float>(Points);
+    } else {
+      return magnitude;
+    }
+  }
+
+  /**
+   * @brief Returns one bin after transform()
+   *
+   * @param p_bin - bin index, less than bins
+   * @return std::complex<float> - the bin in units of the input. Q15
+   * transforms are scaled back up by Points.
+   */
+  [[nodiscard]] std::complex<float> coefficient(std::size_t p_bin) const
+  {
+    auto const [real_part, imag_part] = parts(p_bin);
+    std::complex<float> const value{ real_part, imag_part };
+    if constexpr (q15) {
+      return value * static_cast<float>(Points);
+    } else {
+      return value;
+    }
+  }
+
+private:
+  static constexpr std::size_t half = Points / 2;
+  static constexpr bool q15 = std::same_as<Sample, std::int16_t>;
+  static constexpr std::size_t stride =
+    Layout == fft_layout::interleaved ? 2 : 1;
+  static constexpr std::size_t imag_offset =
+    Layout == fft_layout::interleaved ? 1 : half;
+  using wide_t = std::conditional_t<q15, std::int32_t, float>;
+
+  /// real and imaginary part of a bin as stored after split()
+  std::pair<float, float> parts(std::size_t p_bin) const
+  {
+    if (p_bin == 0) {
+      return { static_cast<float>(real(0)), 0.0f };
+    }
+    if (p_bin == half) {
+      // the real Nyquist bin is packed next to DC
+      return { static_cast<float>(imag(0)), 0.0f };
+    }
+    return { static_cast<float>(real(p_bin)),
+             static_cast<float>(imag(p_bin)) };
+  }
+
+  /// cos and sin of the angle, the twiddle factor is cos - i sin
+  struct twiddle_table
+  {
+    std::array<Sample, half> cos{};
+    std::array<Sample, half> sin{};
+  };
+
+  /// W_N^k for k in [0, Points / 2)
+  static constexpr twiddle_table base_twiddles = [] {
+    twiddle_table table;
+    for (std::size_t k = 0; k < half; k++) {
+      auto const root = detail::unit_root(k, Points);
+      table.cos[k] = detail::to_sample<Sample>(root.cos);
+      table.sin[k] = detail::to_sample<Sample>(root.sin);
+    }
+    return table;
+  }();
+
+  /// the twiddles of the stage with span h start at index h - 1
+  static constexpr twiddle_table stage_twiddles = [] {
+    twiddle_table table;
+    for (std::size_t span = 1; span < half; span *= 2) {
+      for (std::size_t j = 0; j < span; j++) {
+        auto const root = detail::unit_root(j, 2 * span);
+        table.cos[span - 1 + j] = detail::to_sample<Sample>(root.cos);
+        table.sin[span - 1 + j] = detail::to_sample<Sample>(root.sin);
+      }
+    }
+    return table;
+  }();
+
+  Sample& real(std::size_t p_index)
+  {
+    return m_data[p_index * stride];
+  }
+
+  Sample& imag(std::size_t p_index)
+  {
+    return m_data[p_index * stride + imag_offset];
+  }
+
+  Sample real(std::size_t p_index) const
+  {
+    return m_data[p_index * stride];
+  }
+
+  Sample imag(std::size_t p_index) const
+  {
+    return m_data[p_index * stride + imag_offset];
+  }
+
+  /// p_a * p_cos + p_b * p_sin, rounded back to Q15 for fixed point
+  static wide_t rotate(wide_t p_a, wide_t p_b, Sample p_cos, Sample p_sin)
+  {
+    if constexpr (q15) {
+      return (p_a * p_cos + p_b * p_sin + (1 << 14)) >> 15;
+    } else {
+      return p_a * p_cos + p_b * p_sin;
+    }
+  }
+
+  /// stores a butterfly output, halving Q15 once per stage to prevent
+  /// overflow
+  static Sample narrow(wide_t p_value, int p_stages)
+  {
+    if constexpr (q15) {
+      return static_cast<Sample>(p_value >> p_stages);
+    } else {
+      return p_value;
+    }
+  }
+
+  /// stores a split output, which is half of the sum, Q15 is halved again
+  static Sample halve(wide_t p_value)
+  {
+    if constexpr (q15) {
+      return static_cast<Sample>(p_value >> 2);
+    } else {
+      return p_value * 0.5f;
+    }
+  }
+
+  void bit_reverse()
+  {
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < half - 1; i++) {
+      if (i < j) {
+        std::swap(real(i), real(j));
+        std::swap(imag(i), imag(j));
+      }
+      auto bit = half >> 1;
+      while (j & bit) {
+        j ^= bit;
+        bit >>= 1;
+      }
+      j |= bit;
+    }
+  }
+
+  /**
+   * @brief Runs the first two stages as one radix-4 pass
+   *
+   * Their twiddles are 1 and -i, so no multiplications are needed, and the
+   * remaining stages have at least four butterflies per group to vectorize.
+   */
+  void first_stages()
+  {
+    for (std::size_t group = 0; group < half; group += 4) {
+      wide_t const p0_real = real(group);
+      wide_t const p0_imag = imag(group);
+      wide_t const p1_real = real(group + 1);
+      wide_t const p1_imag = imag(group + 1);
+      wide_t const p2_real = real(group + 2);
+      wide_t const p2_imag = imag(group + 2);
+      wide_t const p3_real = real(group + 3);
+      wide_t const p3_imag = imag(group + 3);
+
+      auto const s0_real = p0_real + p1_real;
+      auto const s0_imag = p0_imag + p1_imag;
+      auto const s1_real = p0_real - p1_real;
+      auto const s1_imag = p0_imag - p1_imag;
+      auto const s2_real = p2_real + p3_real;
+      auto const s2_imag = p2_imag + p3_imag;
+      // multiplied by -i
+      auto const s3_real = p2_imag - p3_imag;
+      auto const s3_imag = p3_real - p2_real;
+
+      real(group) = narrow(s0_real + s2_real, 2);
+      imag(group) = narrow(s0_imag + s2_imag, 2);
+      real(group + 1) = narrow(s1_real + s3_real, 2);
+      imag(group + 1) = narrow(s1_imag + s3_imag, 2);
+      real(group + 2) = narrow(s0_real - s2_real, 2);
+      imag(group + 2) = narrow(s0_imag - s2_imag, 2);
+      real(group + 3) = narrow(s1_real - s3_real, 2);
+      imag(group + 3) = narrow(s1_imag - s3_imag, 2);
+    }
+  }
+
+  void butterflies()
+  {
+    first_stages();
+    if constexpr (half > 4) {
+      stage<4>();
+    }
+  }
+
+  /**
+   * @brief Runs the stage whose butterflies span Span points, then the next
+   *
+   * Span is a constant so the compiler knows the butterfly inputs never
+   * overlap and can vectorize the inner loop without runtime checks.
+   */
+  template<std::size_t Span>
+  void stage()
+  {
+    for (std::size_t group = 0; group < half; group += 2 * Span) {
+      for (std::size_t j = 0; j < Span; j++) {
+        Sample cos = 0;
+        Sample sin = 0;
+        if constexpr (Layout == fft_layout::split) {
+          cos = stage_twiddles.cos[Span - 1 + j];
+          sin = stage_twiddles.sin[Span - 1 + j];
+        } else {
+          cos = base_twiddles.cos[j * (half / Span)];
+          sin = base_twiddles.sin[j * (half / Span)];
+        }
+
+        auto const a = group + j;
+        auto const b = a + Span;
+        wide_t const b_real = real(b);
+        wide_t const b_imag = imag(b);
+        auto const t_real = rotate(b_real, b_imag, cos, sin);
+        auto const t_imag = rotate(b_imag, -b_real, cos, sin);
+        wide_t const a_real = real(a);
+        wide_t const a_imag = imag(a);
+        real(a) = narrow(a_real + t_real, 1);
+        imag(a) = narrow(a_imag + t_imag, 1);
+        real(b) = narrow(a_real - t_real, 1);
+        imag(b) = narrow(a_imag - t_imag, 1);
+      }
+    }
+
+    if constexpr (2 * Span < half) {
+      stage<2 * Span>();
+    }
+  }
+
+  /**
+   * @brief Separates the spectra of the even and odd samples
+   *
+   * With Z the transform of the packed sequence, X[k] = (E + W^k O) / 2 and
+   * X[N/2 - k] = conj(E - W^k O) / 2, where E = Z[k] + conj(Z[N/2 - k]) and
+   * O = (Z[k] - conj(Z[N/2 - k])) / i. Q15 halves the result once more.
+   */
+  void split()
+  {
+    wide_t const dc_real = real(0);
+    wide_t const dc_imag = imag(0);
+    real(0) = narrow(dc_real + dc_imag, 1);
+    imag(0) = narrow(dc_real - dc_imag, 1);
+
+    for (std::size_t k = 1; k <= half / 2; k++) {
+      auto const mirror = half - k;
+      wide_t const z_real = real(k);
+      wide_t const z_imag = imag(k);
+      wide_t const y_real = real(mirror);
+      wide_t const y_imag = imag(mirror);
+
+      auto const even_real = z_real + y_real;
+      auto const even_imag = z_imag - y_imag;
+      auto const odd_real = z_imag + y_imag;
+      auto const odd_imag = y_real - z_real;
+
+      auto const cos = base_twiddles.cos[k];
+      auto const sin = base_twiddles.sin[k];
+      auto const w_real = rotate(odd_real, odd_imag, cos, sin);
+      auto const w_imag = rotate(odd_imag, -odd_real, cos, sin);
+
+      real(k) = halve(even_real + w_real);
+      imag(k) = halve(even_imag + w_imag);
+      real(mirror) = halve(even_real - w_real);
+      imag(mirror) = halve(w_imag - even_imag);
+    }
+  }
+
+  std::array<Sample, Points> m_data{};
+};
+
+/**
+ * @brief Per axis vibration spectra from FIFO drain blocks
+ *
+ * Samples are collected into frames of Points samples per axis. Each sample
+ * is weighted by a Hann window as it arrives, so a frame is transformed as
+ * soon as its last sample is added. The frames do not overlap. A change of
+ * full scale or resolution discards the frame in progress.
+ *
+ * The spectra are of the calibrated acceleration when a calibration is given
+ * to configure_calibration(). The transform is linear, so the calibration is
+ * applied to the bins of each frame instead of to every sample: the gain
+ * matrix combines the complex bins of the three axes and the offset lands in
+ * the DC bin and, through the window, in bin 1.
+ *
+ * Memory is one real_fft per axis plus the three spectra, for example 18KiB
+ * for 1024 float points or 12KiB for 1024 Q15 points.
+ *
+ * @tparam Points - frame length, a power of two such as 256, 512 or 1024
+ * @tparam Sample - float or std::int16_t for Q15
+ * @tparam Layout - storage of the complex working data
+ */
+template<std::size_t Points,
+         typename Sample = float,
+         fft_layout Layout = fft_layout::split>
+class vibration_spectrum
+{
+public:
+  using fft_t = real_fft<Points, Sample, Layout>;
+
+  /**
+   * @brief The number of bins from DC to the Nyquist frequency
+   */
+  static constexpr std::size_t bins = fft_t::bins;
+
+  /**
+   * @brief Returns the bin nearest to a frequency
+   *
+   * @param p_frequency - frequency of interest
+   * @param p_sample_rate - output data rate of the samples, see
+   * lis3dhtr::output_data_rate()
+   * @return std::size_t - the bin index, at most bins - 1
+   */
+  static constexpr std::size_t bin(hal::hertz p_frequency,
+                                   hal::hertz p_sample_rate)
+  {
+    auto const position = p_frequency * Points / p_sample_rate;
+    if (position <= 0.0f) {
+      return 0;
+    }
+    return std::min(static_cast<std::size_t>(position + 0.5f), bins - 1);
+  }
+
+  /**
+   * @brief Adds a block of samples, such as a FIFO burst
+   *
+   * @param p_samples - raw samples in the order they were acquired
+   * @return true - at least one frame completed and the spectra were updated
+   */
+  bool add(std::span<lis3dhtr::raw_read_t const> p_samples)
+  {
+    bool updated = false;
+    for (auto const& sample : p_samples) {
+      if (sample.full_scale != m_full_scale ||
+          sample.resolution != m_resolution) {
+        m_full_scale = sample.full_scale;
+        m_resolution = sample.resolution;
+        m_filled = 0;
+      }
+
+      m_axes[0].set(m_filled, weigh(sample.x));
+      m_axes[1].set(m_filled, weigh(sample.y));
+      m_axes[2].set(m_filled, weigh(sample.z));
+
+      if (++m_filled == Points) {
+        finish_frame();
+        m_filled = 0;
+        updated = true;
+      }
+    }
+    return updated;
+  }
+
+  /**
+   * @brief Returns the amplitude spectrum of the last completed frame
+   *
+   * A sinusoid centered on a bin shows its peak amplitude in that bin.
+   *
+   * @param p_axis - 0 for x, 1 for y and 2 for z
+   * @return std::span<float const, bins> - amplitudes in g's
+   */
+  [[nodiscard]] std::span<float const, bins> magnitudes(
+    std::size_t p_axis) const
+  {
+    return m_magnitudes[p_axis];
+  }
+
+  /**
+   * @brief Returns the mean square acceleration within a band of bins
+   *
+   * Corrected for the noise bandwidth of the Hann window, so the sum over
+   * every bin matches the mean square of the frame.
+   *
+   * @param p_axis - 0 for x, 1 for y and 2 for z
+   * @param p_first_bin - first bin of the band
+   * @param p_last_bin - one past the last bin of the band
+   * @return float - energy of the band in g's squared
+   */
+  [[nodiscard]] float band_energy(std::size_t p_axis,
+                                  std::size_t p_first_bin,
+                                  std::size_t p_last_bin) const
+  {
+    float energy = 0.0f;
+    for (std::size_t k = p_first_bin; k < std::min(p_last_bin, bins); k++) {
+      auto const amplitude = m_magnitudes[p_axis][k];
+      // a sinusoid's mean square is half its squared amplitude
+      auto const weight = (k == 0 || k == bins - 1) ? 1.0f : 0.5f;
+      energy += amplitude * amplitude * weight;
+    }
+    return energy / hann_noise_bandwidth;
+  }
+
+  /**
+   * @brief Applies a calibration to the spectra of the following frames
+   *
+   * @param p_calibration - the model to apply, usually
+   * lis3dhtr_core::calibration() of the driver the samples come from. A
+   * default constructed model removes the calibration.
+   */
+  void configure_calibration(lis3dhtr::calibration_model const& p_calibration)
+  {
+    m_calibration = p_calibration;
+  }
+
+  /**
+   * @return std::uint32_t - the number of frames transformed
+   */
+  [[nodiscard]] std::uint32_t frames() const
+  {
+    return m_frames;
+  }
+
+private:
+  static constexpr bool q15 = std::same_as<Sample, std::int16_t>;
+  /// equivalent noise bandwidth of the Hann window, in bins
+  static constexpr float hann_noise_bandwidth = 1.5f;
+
+  /// the periodic Hann window, which sums to Points / 2
+  static constexpr std::array<Sample, Points> window = [] {
+    std::array<Sample, Points> table{};
+    for (std::size_t n = 0; n < Points; n++) {
+      auto const root = detail::unit_root(n, Points);
+      table[n] = detail::to_sample<Sample>(0.5 - 0.5 * root.cos);
+    }
+    return table;
+  }();
+
+  /// the number of bits Q15 samples are shifted up by, to +/-16384
+  std::int32_t q15_shift() const
+  {
+    return 15 - static_cast<std::int32_t>(m_resolution);
+  }
+
+  Sample weigh(std::int16_t p_digits) const
+  {
+    if constexpr (q15) {
+      auto const scaled = std::int32_t{ p_digits } << q15_shift();
+      return static_cast<Sample>((scaled * window[m_filled] + (1 << 14)) >>
+                                 15);
+    } else {
+      return static_cast<float>(p_digits) * window[m_filled];
+    }
+  }
+
+  void finish_frame()
+  {
+    auto const conversion =
+      lis3dhtr::conversion_for(m_calibration, m_full_scale, m_resolution);
+    // undo the gain of the window
+    auto scale = 1.0f / static_cast<float>(Points / 2);
+    if constexpr (q15) {
+      scale /= static_cast<float>(1 << q15_shift());
+    }
+
+    for (auto& axis : m_axes) {
+      axis.transform();
+    }
+
+    for (std::size_t row = 0; row < 3; row++) {
+      auto const& gain = conversion.gain[row];
+      auto const offset = conversion.offset[row];
+      auto& magnitudes = m_magnitudes[row];
+      for (std::size_t k = 0; k < bins; k++) {
+        std::complex<float> value{};
+        if (conversion.cross_axis) {
+          for (std::size_t column = 0; column < 3; column++) {
+            value += gain[column] * m_axes[column].coefficient(k);
+          }
+        } else {
+          value = gain[row] * m_axes[row].coefficient(k);
+        }
+        value *= scale;
+        // the Hann window spreads a constant over DC and, at minus half its
+        // amplitude, bin 1
+        if (k == 0) {
+          value += offset;
+        } else if (k == 1) {
+          value -= 0.5f * offset;
+        }
+        // single sided, the bins between DC and Nyquist count twice
+        auto const sides = (k == 0 || k == bins - 1) ? 1.0f : 2.0f;
+        magnitudes[k] =
+          std::sqrt(value.real() * value.real() + value.imag() * value.imag()) *
+          sides;
+      }
+    }
+    m_frames++;
+  }
+
+  std::array<fft_t, 3> m_axes{};
+  std::array<std::array<float, bins>, 3> m_magnitudes{};
+  std::size_t m_filled = 0;
+  std::uint32_t m_frames = 0;
+  lis3dhtr::max_acceleration m_full_scale = lis3dhtr::max_acceleration::g2;
+  hal::byte m_resolution = 0;
+  lis3dhtr::calibration_model m_calibration{};
+};
+}  // namespace hal::stm_imu
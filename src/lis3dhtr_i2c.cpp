@@ -13,137 +13,49 @@
 // limitations under the License.
 
 #include "../include/libhal-stm-imu/lis3dhtr_i2c.hpp"
-#include "libhal/error.hpp"
-#include "lis3dhtr_constants.hpp"
 
 namespace hal::stm_imu {
-using namespace std::chrono_literals;
-using namespace hal::literals;
 
 // public
 
 lis3dhtr_i2c::lis3dhtr_i2c(hal::i2c& p_i2c,
                            hal::byte p_device_address,
                            max_acceleration p_gscale)
-  : m_i2c(&p_i2c)
-  , m_address(p_device_address)
-  , m_gscale(static_cast<hal::byte>(p_gscale))
+  : lis3dhtr_i2c(p_i2c, p_device_address, settings{ .full_scale = p_gscale })
 {
-  verify_device();
-  power_on();
-  configure_full_scale(p_gscale);
 }
 
-void lis3dhtr_i2c::verify_device()
-{
-  // the expected value as read from the data sheet is 0x33
-  constexpr auto expected = 0x33;
-  auto who_am_i =
-    hal::write_then_read<1>(*m_i2c,
-                            m_address,
-                            std::array{ hal::stm_imu::who_am_i_register },
-                            hal::never_timeout());
-
-  if (who_am_i[0] != expected) {
-    hal::safe_throw(hal::no_such_device(expected, this));
-  }
-}
-
-void lis3dhtr_i2c::power_on()
-{
-  configure_data_rates(data_rate_config::mode_7);
-}
-
-void lis3dhtr_i2c::power_off()
+lis3dhtr_i2c::lis3dhtr_i2c(hal::i2c& p_i2c,
+                           hal::byte p_device_address,
+                           settings const& p_settings)
+  : lis3dhtr_core(lis3dhtr_i2c_transport(p_i2c, p_device_address),
+                  p_settings)
 {
-  configure_data_rates(data_rate_config::mode_0);
 }
 
-void lis3dhtr_i2c::configure_data_rates(data_rate_config p_data_rate)
+lis3dhtr_i2c::lis3dhtr_i2c(hal::i2c& p_i2c,
+                           hal::byte p_device_address,
+                           settings const& p_settings,
+                           fast_start_t)
+  : lis3dhtr_core(lis3dhtr_i2c_transport(p_i2c, p_device_address),
+                  p_settings,
+                  fast_start)
 {
-
-  constexpr auto configure_reg_bit_mask = hal::bit_mask::from<7, 4>();
-  auto ctrl_reg1_array = std::array{ ctrl_reg1 };
-  auto ctrl_reg1_data = hal::write_then_read<1>(
-    *m_i2c, m_address, ctrl_reg1_array, hal::never_timeout());
-
-  hal::bit_modify(ctrl_reg1_data[0])
-    .insert<configure_reg_bit_mask>(static_cast<hal::byte>(p_data_rate));
-
-  hal::write(*m_i2c,
-             m_address,
-             std::array{ ctrl_reg1, ctrl_reg1_data[0] },
-             hal::never_timeout());
 }
 
-void lis3dhtr_i2c::configure_full_scale(max_acceleration p_gravity_code)
+lis3dhtr_i2c::lis3dhtr_i2c(hal::i2c& p_i2c,
+                           hal::byte p_device_address,
+                           warm_restart_t)
+  : lis3dhtr_core(lis3dhtr_i2c_transport(p_i2c, p_device_address),
+                  warm_restart)
 {
-
-  m_gscale = static_cast<hal::byte>(p_gravity_code);
-
-  constexpr auto configure_reg_bit_mask = hal::bit_mask::from<5, 4>();
-  auto ctrl_reg4_array = std::array{ ctrl_reg4 };
-  auto ctrl_reg4_data = hal::write_then_read<1>(
-    *m_i2c, m_address, ctrl_reg4_array, hal::never_timeout());
-  hal::bit_modify(ctrl_reg4_data[0])
-    .insert<configure_reg_bit_mask>(static_cast<hal::byte>(p_gravity_code));
-
-  hal::write(*m_i2c,
-             m_address,
-             std::array{ ctrl_reg4, ctrl_reg4_data[0] },
-             hal::never_timeout());
 }
 
 // private
 
 accelerometer::read_t lis3dhtr_i2c::driver_read()
 {
-  accelerometer::read_t acceleration;
-  constexpr auto number_of_axis = 3;
-  constexpr auto bytes_per_axis = 2;
-  auto xyz_acceleration = hal::write_then_read<number_of_axis * bytes_per_axis>(
-    *m_i2c,
-    m_address,
-    std::array{ hal::stm_imu::read_xyz_axis },
-    hal::never_timeout());
-
-  /* parsing data from accelerometer
-   all data is left justified which means the data will always have the lowest
-   nibble be 0 so we shift it all to the right by 4 and or the low and high
-   bytes together 0000'0000'0000'0000
-  */
-  constexpr auto read_h_bit_mask = hal::bit_mask::from<15, 8>();
-
-  auto x = static_cast<uint16_t>(xyz_acceleration[0]);
-  hal::bit_modify(x).insert<read_h_bit_mask>(
-    static_cast<uint16_t>(xyz_acceleration[1]));
-
-  auto y = static_cast<uint16_t>(xyz_acceleration[2]);
-  hal::bit_modify(y).insert<read_h_bit_mask>(
-    static_cast<uint16_t>(xyz_acceleration[3]));
-
-  auto z = static_cast<uint16_t>(xyz_acceleration[4]);
-  hal::bit_modify(z).insert<read_h_bit_mask>(
-    static_cast<uint16_t>(xyz_acceleration[5]));
-
-  // output_limits is affected by the configured g_scale, if it is set to 2 then
-  // the code is 0, add one to the code and shift 1 by that many, this will
-  // succesfully allow you to map the output to the different amount g's that
-  // are selected.
-  auto output_limits =
-    static_cast<float>(1 << (static_cast<int16_t>(m_gscale) + 1));
-
-  constexpr auto max = static_cast<float>(std::numeric_limits<int16_t>::max());
-  constexpr auto min = static_cast<float>(std::numeric_limits<int16_t>::min());
-
-  auto input_range = std::make_pair(max, min);
-  auto output_range = std::make_pair(-output_limits, output_limits);
-
-  acceleration.x = hal::map(static_cast<int16_t>(x), input_range, output_range);
-  acceleration.y = hal::map(static_cast<int16_t>(y), input_range, output_range);
-  acceleration.z = hal::map(static_cast<int16_t>(z), input_range, output_range);
-
-  return acceleration;
+  return lis3dhtr_core::read();
 }
 
 }  // namespace hal::stm_imu
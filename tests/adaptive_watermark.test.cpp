@@ -0,0 +1,98 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/adaptive_watermark.hpp>
+
+namespace hal::stm_imu {
+void adaptive_watermark_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "adaptive_watermark::adaptive_watermark()"_test = []() {
+    // Setup
+    adaptive_watermark policy;
+
+    // Exercise
+    auto const watermark = policy.watermark();
+
+    // Verify
+    // 31 - (initial latency of 4 + margin of 2)
+    expect(that % 25 == watermark);
+    expect(that % 0U == policy.overruns());
+  };
+
+  "adaptive_watermark::update() follows measured latency"_test = []() {
+    // Setup
+    adaptive_watermark policy;
+
+    // Exercise
+    // the interrupt fires at 26 samples, 5 more arrived before the drain
+    auto const watermark = policy.update(31);
+
+    // Verify
+    expect(that % 5 == policy.latency());
+    expect(that % 24 == watermark);
+  };
+
+  "adaptive_watermark::update() backs off on overrun"_test = []() {
+    // Setup
+    adaptive_watermark policy;
+
+    // Exercise
+    auto const first = policy.update(adaptive_watermark::fifo_depth);
+    auto const second = policy.update(adaptive_watermark::fifo_depth);
+
+    // Verify
+    expect(that % 21 == first);
+    expect(that % 13 == second);
+    expect(that % 2U == policy.overruns());
+  };
+
+  "adaptive_watermark::update() relaxes after clean wakeups"_test = []() {
+    // Setup
+    adaptive_watermark policy({
+      .initial_latency = 4,
+      .margin = 2,
+      .decay_interval = 4,
+    });
+
+    // Exercise
+    for (int i = 0; i < 8; i++) {
+      policy.update(policy.watermark() + 1U);
+    }
+
+    // Verify
+    expect(that % 2 == policy.latency());
+    expect(that % 27 == policy.watermark());
+  };
+
+  "adaptive_watermark::update() never exceeds the FIFO"_test = []() {
+    // Setup
+    adaptive_watermark policy({
+      .initial_latency = 40,
+      .margin = 2,
+      .decay_interval = 16,
+    });
+
+    // Exercise
+    auto const watermark = policy.update(adaptive_watermark::fifo_depth);
+
+    // Verify
+    expect(that % 0 == watermark);
+    expect(that % 31 == policy.latency());
+  };
+};
+}  // namespace hal::stm_imu
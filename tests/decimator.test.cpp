@@ -0,0 +1,205 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/decimator.hpp>
+#include <libhal/error.hpp>
+
+namespace hal::stm_imu {
+namespace {
+using raw_read_t = lis3dhtr::raw_read_t;
+
+std::vector<raw_read_t> tone(std::size_t p_count,
+                             float p_cycles_per_sample,
+                             float p_amplitude,
+                             std::int16_t p_offset = 0)
+{
+  std::vector<raw_read_t> samples(p_count);
+  for (std::size_t i = 0; i < p_count; i++) {
+    auto const phase = 2.0f * std::numbers::pi_v<float> * p_cycles_per_sample *
+                       static_cast<float>(i);
+    auto const value = static_cast<std::int16_t>(
+      std::lround(p_offset + p_amplitude * std::sin(phase)));
+    samples[i] = raw_read_t{
+      .x = value,
+      .y = static_cast<std::int16_t>(-value),
+      .z = p_offset,
+      .full_scale = lis3dhtr::max_acceleration::g2,
+      .resolution = 12,
+    };
+  }
+  return samples;
+}
+
+/// peak output of the x axis once the filters have settled
+template<typename Decimator>
+float settled_peak(Decimator& p_decimator, std::span<raw_read_t const> p_input)
+{
+  std::vector<raw_read_t> output(Decimator::max_outputs(p_input.size()));
+  auto const decimated = p_decimator.process(p_input, output);
+
+  float peak = 0.0f;
+  for (auto const& sample : decimated.subspan(decimated.size() / 2)) {
+    peak = std::max(peak, std::abs(static_cast<float>(sample.x)));
+  }
+  return peak;
+}
+}  // namespace
+
+void decimator_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "decimator::process() emits one sample per factor inputs"_test = []() {
+    // Setup
+    decimator<9, 3> test_subject;
+    auto const input = tone(32 * 27, 0.0f, 0.0f, 1000);
+    std::array<accelerometer::read_t, 32> output{};
+    std::size_t produced = 0;
+
+    // Exercise
+    // one call per FIFO burst
+    for (std::size_t burst = 0; burst < 27; burst++) {
+      auto const block = std::span(input).subspan(burst * 32, 32);
+      produced += test_subject
+                    .process(block, std::span(output).subspan(produced))
+                    .size();
+    }
+
+    // Verify
+    expect(that % 27U == decltype(test_subject)::factor);
+    expect(that % 2U == decltype(test_subject)::max_outputs(32));
+    expect(that % 32U == produced);
+    // 1000 digits at 1mg per digit
+    expect(std::abs(output.back().x - 1.0f) < 0.001f) << output.back().x;
+    expect(std::abs(output.back().y + 1.0f) < 0.001f) << output.back().y;
+    expect(std::abs(output.back().z - 1.0f) < 0.001f) << output.back().z;
+  };
+
+  "decimator::process() applies the calibration"_test = []() {
+    // Setup
+    decimator<9, 3> test_subject;
+    lis3dhtr::calibration_model model{};
+    model.bias = { 0.1f, 0.0f, 0.0f };
+    model.scale = { 1.0f, 2.0f, 1.0f };
+    model.cross_axis[2][0] = 0.5f;
+    test_subject.configure_calibration(model);
+    auto const input = tone(27 * 40, 0.0f, 0.0f, 1000);
+    std::array<accelerometer::read_t, 40> output{};
+
+    // Exercise
+    auto const decimated = test_subject.process(input, output);
+
+    // Verify
+    // x = 1g - 0.1g, y = 2 * -1g, z = 1g + 0.5 * 0.9g
+    expect(that % 40U == decimated.size());
+    expect(std::abs(output.back().x - 0.9f) < 0.001f) << output.back().x;
+    expect(std::abs(output.back().y + 2.0f) < 0.001f) << output.back().y;
+    expect(std::abs(output.back().z - 1.45f) < 0.001f) << output.back().z;
+  };
+
+  "decimator::process() fixed point has unity gain at DC"_test = []() {
+    // Setup
+    decimator<36, 3, raw_read_t> test_subject;
+    auto const input = tone(108 * 40, 0.0f, 0.0f, -2048);
+    std::vector<raw_read_t> output(40);
+
+    // Exercise
+    auto const decimated = test_subject.process(input, output);
+
+    // Verify
+    expect(that % 40U == decimated.size());
+    expect(that % -2048 == decimated.back().x);
+    expect(that % 2048 == decimated.back().y);
+    expect(that % -2048 == decimated.back().z);
+    expect(lis3dhtr::max_acceleration::g2 == decimated.back().full_scale);
+    expect(that % 12 == decimated.back().resolution);
+  };
+
+  "decimator::process() passes the passband flat"_test = []() {
+    // Setup
+    decimator<9, 3, raw_read_t> test_subject;
+    // 10% of the output rate
+    auto const input = tone(27 * 400, 0.1f / 27, 1000.0f);
+
+    // Exercise
+    auto const peak = settled_peak(test_subject, input);
+
+    // Verify
+    // within 0.1dB, the CIC droop is compensated
+    expect(std::abs(peak - 1000.0f) < 12.0f) << peak;
+  };
+
+  "decimator::process() rejects tones that would alias"_test = []() {
+    // Setup
+    decimator<9, 3, raw_read_t> test_subject;
+    // 1.6 times the output rate, aliases to 40% of it without filtering
+    auto const input = tone(27 * 400, 1.6f / 27, 2000.0f);
+
+    // Exercise
+    auto const peak = settled_peak(test_subject, input);
+
+    // Verify
+    // at least 50dB down
+    expect(peak < 6.4f) << peak;
+  };
+
+  "decimator::process() rejects an output that is too small"_test = []() {
+    // Setup
+    decimator<2, 2, raw_read_t> test_subject;
+    auto const input = tone(32, 0.0f, 0.0f, 100);
+    std::array<raw_read_t, 8> output{};
+    test_subject.process(std::span(input).first(3), output);
+
+    // Exercise
+    // 3 samples are held, so 13 more make 4 outputs
+    auto const pending = test_subject.pending_outputs(13);
+    auto const too_small = std::span(output).first(3);
+    bool const rejected = throws<hal::argument_out_of_domain>(
+      [&]() { test_subject.process(std::span(input).first(13), too_small); });
+    auto const decimated =
+      test_subject.process(std::span(input).first(13), output);
+
+    // Verify
+    expect(that % 4U == pending);
+    expect(rejected);
+    // nothing was consumed by the rejected call
+    expect(that % 4U == decimated.size());
+  };
+
+  "decimator::reset()"_test = []() {
+    // Setup
+    decimator<4, 2, raw_read_t> test_subject;
+    auto const busy = tone(64, 0.0f, 0.0f, 1500);
+    auto const quiet = tone(8, 0.0f, 0.0f, 0);
+    std::array<raw_read_t, 8> output{};
+    test_subject.process(busy, output);
+
+    // Exercise
+    test_subject.reset();
+    auto const decimated = test_subject.process(quiet, output);
+
+    // Verify
+    expect(that % 1U == decimated.size());
+    expect(that % 0 == decimated[0].x);
+  };
+};
+}  // namespace hal::stm_imu
@@ -0,0 +1,264 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/goertzel.hpp>
+
+namespace hal::stm_imu {
+namespace {
+std::vector<lis3dhtr::raw_read_t> vibration(
+  std::size_t p_count,
+  float p_cycles_per_sample,
+  lis3dhtr::max_acceleration p_full_scale = lis3dhtr::max_acceleration::g2)
+{
+  std::vector<lis3dhtr::raw_read_t> samples(p_count);
+  for (std::size_t n = 0; n < p_count; n++) {
+    auto const phase =
+      2.0f * std::numbers::pi_v<float> * p_cycles_per_sample * n;
+    samples[n] = lis3dhtr::raw_read_t{
+      .x = static_cast<std::int16_t>(std::lround(500.0f * std::sin(phase))),
+      .y = static_cast<std::int16_t>(std::lround(250.0f * std::cos(phase))),
+      .z = 1000,
+      .full_scale = p_full_scale,
+      .resolution = 12,
+    };
+  }
+  return samples;
+}
+}  // namespace
+
+void goertzel_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "goertzel::add() measures the amplitude of each bin"_test = []() {
+    // Setup
+    goertzel<256, 0, 20, 40> test_subject;
+    auto const samples = vibration(256, 20.0f / 256);
+
+    // Exercise
+    auto const updated = test_subject.add(samples);
+
+    // Verify
+    auto const x = test_subject.amplitudes(0);
+    auto const y = test_subject.amplitudes(1);
+    auto const z = test_subject.amplitudes(2);
+    expect(that % true == updated);
+    expect(that % 1U == test_subject.blocks());
+    // 1mg per digit
+    expect(std::abs(x[1] - 0.5f) < 0.002f) << x[1];
+    expect(std::abs(y[1] - 0.25f) < 0.002f) << y[1];
+    expect(x[2] < 0.002f) << x[2];
+    expect(x[0] < 0.002f) << x[0];
+    expect(std::abs(z[0] - 1.0f) < 0.002f) << z[0];
+    expect(z[1] < 0.002f) << z[1];
+  };
+
+  "goertzel_fixed::add() matches the float goertzel"_test = []() {
+    // Setup
+    goertzel<256, 0, 20, 40> reference;
+    goertzel_fixed<256, 0, 20, 40> test_subject;
+    auto const samples = vibration(256, 20.0f / 256);
+    reference.add(samples);
+
+    // Exercise
+    auto const updated = test_subject.add(samples);
+
+    // Verify
+    expect(that % true == updated);
+    expect(that % 1U == test_subject.blocks());
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      for (std::size_t bin = 0; bin < 3; bin++) {
+        auto const fixed = test_subject.amplitudes(axis)[bin];
+        auto const expected = reference.amplitudes(axis)[bin];
+        // well below a digit, 1mg
+        expect(std::abs(fixed - expected) < 0.0002f) << axis << bin << fixed;
+      }
+    }
+  };
+
+  "goertzel_fixed::add() matches the float goertzel at low bins"_test = []() {
+    // Setup
+    // 2 - 2 cos(w) is only 3.8e-5 at bin 1 of 1024 samples
+    goertzel<1024, 0, 1, 2, 3> reference;
+    goertzel_fixed<1024, 0, 1, 2, 3> test_subject;
+    auto const samples = vibration(1024, 1.0f / 1024);
+    reference.add(samples);
+
+    // Exercise
+    auto const updated = test_subject.add(samples);
+
+    // Verify
+    expect(that % true == updated);
+    expect(std::abs(test_subject.amplitudes(0)[1] - 0.5f) < 0.0002f)
+      << test_subject.amplitudes(0)[1];
+    expect(std::abs(test_subject.amplitudes(1)[1] - 0.25f) < 0.0002f)
+      << test_subject.amplitudes(1)[1];
+    expect(std::abs(test_subject.amplitudes(2)[0] - 1.0f) < 0.0002f)
+      << test_subject.amplitudes(2)[0];
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      for (std::size_t bin = 0; bin < 4; bin++) {
+        auto const fixed = test_subject.amplitudes(axis)[bin];
+        auto const expected = reference.amplitudes(axis)[bin];
+        // the float filters leak up to 0.6 digits of the DC into bin 1
+        expect(std::abs(fixed - expected) < 0.001f) << axis << bin << fixed;
+      }
+    }
+  };
+
+  "goertzel_fixed::add() matches the float goertzel at bin 1 of 512"_test =
+    []() {
+      // Setup
+      goertzel<512, 0, 1> reference;
+      goertzel_fixed<512, 0, 1> test_subject;
+      auto const samples = vibration(512, 1.0f / 512);
+      reference.add(samples);
+
+      // Exercise
+      test_subject.add(samples);
+
+      // Verify
+      expect(std::abs(test_subject.amplitudes(0)[1] - 0.5f) < 0.0002f)
+        << test_subject.amplitudes(0)[1];
+      for (std::size_t axis = 0; axis < 3; axis++) {
+        for (std::size_t bin = 0; bin < 2; bin++) {
+          auto const fixed = test_subject.amplitudes(axis)[bin];
+          auto const expected = reference.amplitudes(axis)[bin];
+          expect(std::abs(fixed - expected) < 0.0005f) << axis << bin << fixed;
+        }
+      }
+    };
+
+  "goertzel_fixed::add() holds full scale at the largest block"_test = []() {
+    // Setup
+    goertzel_fixed<1024, 0, 512> test_subject;
+    std::vector<lis3dhtr::raw_read_t> samples(1024);
+    for (std::size_t n = 0; n < samples.size(); n++) {
+      // the DC bin grows fastest, the Nyquist bin alternates
+      samples[n] = lis3dhtr::raw_read_t{
+        .x = -2048,
+        .y = static_cast<std::int16_t>(n % 2 == 0 ? 2047 : -2048),
+        .z = 2047,
+        .full_scale = lis3dhtr::max_acceleration::g2,
+        .resolution = 12,
+      };
+    }
+
+    // Exercise
+    test_subject.add(samples);
+
+    // Verify
+    auto const x = test_subject.amplitudes(0);
+    auto const y = test_subject.amplitudes(1);
+    auto const z = test_subject.amplitudes(2);
+    // exact to a fifth of a digit, 1mg
+    expect(std::abs(x[0] - 2.048f) < 0.0002f) << x[0];
+    expect(std::abs(y[0] - 0.0005f) < 0.0002f) << y[0];
+    expect(std::abs(y[1] - 2.0475f) < 0.0002f) << y[1];
+    expect(std::abs(z[0] - 2.047f) < 0.0002f) << z[0];
+  };
+
+  "goertzel::add() with a calibration"_test = []() {
+    // Setup
+    goertzel<256, 0, 20> test_subject;
+    lis3dhtr::calibration_model model{};
+    model.bias = { 0.0f, 0.0f, 0.1f };
+    model.scale = { 2.0f, 1.0f, 1.0f };
+    // z picks up x
+    model.cross_axis[2][0] = 1.0f;
+    test_subject.configure_calibration(model);
+    auto const samples = vibration(256, 20.0f / 256);
+
+    // Exercise
+    test_subject.add(samples);
+
+    // Verify
+    auto const x = test_subject.amplitudes(0);
+    auto const z = test_subject.amplitudes(2);
+    expect(std::abs(x[1] - 1.0f) < 0.002f) << x[1];
+    expect(std::abs(z[0] - 0.9f) < 0.002f) << z[0];
+    expect(std::abs(z[1] - 1.0f) < 0.002f) << z[1];
+  };
+
+  "goertzel::add() updates once per block"_test = []() {
+    // Setup
+    goertzel<64, 8> test_subject;
+    auto const samples = vibration(32, 8.0f / 64);
+    std::vector<bool> updates;
+
+    // Exercise
+    // FIFO bursts of 32 samples
+    for (int burst = 0; burst < 5; burst++) {
+      updates.push_back(test_subject.add(samples));
+    }
+
+    // Verify
+    expect(that % 2U == test_subject.blocks());
+    expect(updates == std::vector<bool>{ false, true, false, true, false });
+    expect(std::abs(test_subject.amplitudes(0)[0] - 0.5f) < 0.005f);
+  };
+
+  "goertzel::add() restarts on a full scale change"_test = []() {
+    // Setup
+    goertzel<64, 8> test_subject;
+    auto const before = vibration(32, 8.0f / 64);
+    auto const after = vibration(64, 8.0f / 64, lis3dhtr::max_acceleration::g4);
+
+    // Exercise
+    test_subject.add(before);
+    auto const early = test_subject.add(std::span(after).first(32));
+    test_subject.add(std::span(after).subspan(32));
+
+    // Verify
+    expect(that % false == early);
+    expect(that % 1U == test_subject.blocks());
+    // 2mg per digit at 4g
+    auto const amplitude = test_subject.amplitudes(0)[0];
+    expect(std::abs(amplitude - 1.0f) < 0.01f) << amplitude;
+  };
+
+  "goertzel_bin() and goertzel::frequency()"_test = []() {
+    constexpr auto rate = lis3dhtr::output_data_rate(
+      lis3dhtr::data_rate_config::mode_7, lis3dhtr::operating_mode::normal);
+    using tracker = goertzel<512, goertzel_bin(50.0f, rate, 512)>;
+
+    // 400Hz / 512 = 0.78Hz per bin
+    expect(that % 64U == goertzel_bin(50.0f, rate, 512));
+    expect(std::abs(tracker::frequency(0, rate) - 50.0f) < 0.001f);
+  };
+
+  "goertzel::frequency() at the estimated data rate"_test = []() {
+    // Setup
+    using tracker = goertzel<512, 64>;
+    sample_rate_estimator estimator(400.0f, 1'000'000.0f);
+    // the device runs 2% fast, one drain of 32 samples every 78.4ms
+    for (std::uint64_t drain = 0; drain < 64; drain++) {
+      auto const index = 31 + 32 * drain;
+      estimator.update(index, index * 1'000'000 / 408);
+    }
+
+    // Exercise
+    auto const frequency = tracker::frequency(0, estimator);
+
+    // Verify
+    expect(std::abs(frequency - 51.0f) < 0.05f) << frequency;
+  };
+};
+}  // namespace hal::stm_imu
@@ -0,0 +1,618 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+#include <libhal/error.hpp>
+#include <libhal/i2c.hpp>
+#include <libhal/output_pin.hpp>
+#include <libhal/spi.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+namespace hal::stm_imu {
+/**
+ * @brief Register accurate model of the LIS3DH accelerometer for host tests
+ *
+ * The model implements the register map from 0x07 to 0x3F, the I2C and SPI
+ * auto-increment rules, the four FIFO modes, ODR timed sample generation and
+ * the data overrun flags. Time only advances when `advance()` is called which
+ * keeps every test deterministic.
+ */
+class lis3dh_simulator
+{
+public:
+  /// Acceleration in g's applied to the simulated proof mass
+  struct acceleration
+  {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+  };
+
+  /// Produces the acceleration for the sample with the given index
+  using generator = std::function<acceleration(std::uint64_t p_index)>;
+
+  static constexpr hal::byte status_reg_aux = 0x07;
+  static constexpr hal::byte who_am_i = 0x0F;
+  static constexpr hal::byte ctrl_reg0 = 0x1E;
+  static constexpr hal::byte temp_cfg_reg = 0x1F;
+  static constexpr hal::byte ctrl_reg1 = 0x20;
+  static constexpr hal::byte ctrl_reg2 = 0x21;
+  static constexpr hal::byte ctrl_reg3 = 0x22;
+  static constexpr hal::byte ctrl_reg4 = 0x23;
+  static constexpr hal::byte ctrl_reg5 = 0x24;
+  static constexpr hal::byte ctrl_reg6 = 0x25;
+  static constexpr hal::byte reference = 0x26;
+  static constexpr hal::byte status_reg = 0x27;
+  static constexpr hal::byte out_x_l = 0x28;
+  static constexpr hal::byte out_z_h = 0x2D;
+  static constexpr hal::byte fifo_ctrl_reg = 0x2E;
+  static constexpr hal::byte fifo_src_reg = 0x2F;
+  static constexpr hal::byte int1_cfg = 0x30;
+  static constexpr hal::byte int1_src = 0x31;
+  static constexpr hal::byte int2_src = 0x35;
+  static constexpr hal::byte click_src = 0x39;
+  static constexpr hal::byte act_dur = 0x3F;
+  static constexpr std::size_t fifo_depth = 32;
+
+  lis3dh_simulator()
+  {
+    reset();
+  }
+
+  /// Returns every register to its power on value and empties the FIFO
+  void reset()
+  {
+    m_registers.fill(0);
+    m_registers[who_am_i] = 0x33;
+    m_registers[ctrl_reg0] = 0x10;
+    m_registers[ctrl_reg1] = 0x07;
+    m_fifo_count = 0;
+    m_fifo_head = 0;
+    m_latest = {};
+    m_sample_index = 0;
+    m_elapsed = 0.0;
+  }
+
+  /// Sets the source of acceleration for generated samples
+  void source(generator p_generator)
+  {
+    m_generator = std::move(p_generator);
+  }
+
+  /// Returns the output data rate selected by CTRL_REG1
+  [[nodiscard]] float output_data_rate() const
+  {
+    auto odr = static_cast<std::size_t>(m_registers[ctrl_reg1] >> 4);
+    bool low_power = m_registers[ctrl_reg1] & (1 << 3);
+    constexpr std::array<float, 10> rates{
+      0.0f, 1.0f, 10.0f, 25.0f, 50.0f, 100.0f, 200.0f, 400.0f, 1600.0f, 1344.0f
+    };
+    if (odr >= rates.size()) {
+      return 0.0f;
+    }
+    if (odr == 8 && not low_power) {
+      return 0.0f;
+    }
+    if (odr == 9 && low_power) {
+      return 5376.0f;
+    }
+    return rates[odr];
+  }
+
+  /// Advances simulated time, generating samples at the configured ODR
+  void advance(std::chrono::duration<double> p_time)
+  {
+    auto const rate = output_data_rate();
+    if (rate == 0.0f) {
+      return;
+    }
+    m_elapsed += p_time.count() * rate;
+    while (m_elapsed >= 1.0) {
+      m_elapsed -= 1.0;
+      generate_sample();
+    }
+  }
+
+  /// Generates exactly p_count samples regardless of the configured ODR
+  void advance_samples(std::size_t p_count)
+  {
+    for (std::size_t i = 0; i < p_count; i++) {
+      generate_sample();
+    }
+  }
+
+  /// Returns the level of the INT1 pin
+  [[nodiscard]] bool int1() const
+  {
+    auto const ctrl3 = m_registers[ctrl_reg3];
+    bool const data_ready = (ctrl3 & (1 << 4)) && (status() & (1 << 3));
+    bool const watermark = (ctrl3 & (1 << 2)) && (fifo_source() & (1 << 7));
+    bool const overrun = (ctrl3 & (1 << 1)) && (fifo_source() & (1 << 6));
+    bool const level = data_ready || watermark || overrun;
+    bool const active_low = m_registers[ctrl_reg6] & (1 << 1);
+    return active_low ? not level : level;
+  }
+
+  /// Number of samples held by the FIFO
+  [[nodiscard]] std::size_t fifo_count() const
+  {
+    return m_fifo_count;
+  }
+
+  /// Direct access to the register file for test setup and inspection
+  [[nodiscard]] hal::byte& reg(hal::byte p_address)
+  {
+    return m_registers.at(p_address);
+  }
+
+  /// Reads a register as the bus would, including side effects
+  hal::byte bus_read(hal::byte p_address)
+  {
+    if (p_address == status_reg) {
+      return status();
+    }
+    if (p_address == fifo_src_reg) {
+      return fifo_source();
+    }
+    if (p_address >= out_x_l && p_address <= out_z_h) {
+      auto const sample = output_bytes();
+      auto const value = sample[p_address - out_x_l];
+      if (p_address == out_z_h) {
+        consume_output();
+      }
+      return value;
+    }
+    if (p_address == int1_src || p_address == int2_src ||
+        p_address == click_src) {
+      auto const value = m_registers[p_address];
+      m_registers[p_address] = 0;
+      return value;
+    }
+    return m_registers.at(p_address);
+  }
+
+  /// Writes a register as the bus would, read only registers are ignored
+  void bus_write(hal::byte p_address, hal::byte p_value)
+  {
+    if (not writable(p_address)) {
+      return;
+    }
+    m_registers[p_address] = p_value;
+    if ((m_registers[ctrl_reg1] & (1 << 3)) &&
+        (m_registers[ctrl_reg4] & (1 << 3))) {
+      lpen_and_hr_set = true;
+    }
+    if (p_address == fifo_ctrl_reg && fifo_mode() == 0) {
+      m_fifo_count = 0;
+      m_fifo_head = 0;
+    }
+    if (p_address == ctrl_reg5 && (p_value & (1 << 7))) {
+      // BOOT: reload trimming values, the bit clears itself
+      m_registers[ctrl_reg5] &= ~(1 << 7);
+    }
+  }
+
+  /// Returns the next register address when auto-incrementing
+  [[nodiscard]] hal::byte next_address(hal::byte p_address) const
+  {
+    if (p_address == out_z_h && fifo_enabled()) {
+      return out_x_l;
+    }
+    return static_cast<hal::byte>((p_address + 1) & 0x7F);
+  }
+
+  /// Number of bus transactions handled by the I2C and SPI front ends
+  std::size_t transactions = 0;
+  /// Number of hal::spi::transfer calls handled by the SPI front end
+  std::size_t transfers = 0;
+  /// Number of bytes exchanged with the device, addresses included
+  std::size_t bytes = 0;
+  /// Set once a write leaves LPen and HR set together, which the datasheet
+  /// does not allow
+  bool lpen_and_hr_set = false;
+
+private:
+  using sample_bytes = std::array<hal::byte, 6>;
+
+  [[nodiscard]] bool writable(hal::byte p_address) const
+  {
+    if (p_address == ctrl_reg0 || p_address == temp_cfg_reg) {
+      return true;
+    }
+    if (p_address >= ctrl_reg1 && p_address <= reference) {
+      return true;
+    }
+    if (p_address == fifo_ctrl_reg) {
+      return true;
+    }
+    if (p_address >= int1_cfg && p_address <= act_dur) {
+      return p_address != int1_src && p_address != int2_src &&
+             p_address != click_src;
+    }
+    return false;
+  }
+
+  [[nodiscard]] bool fifo_enabled() const
+  {
+    return m_registers[ctrl_reg5] & (1 << 6);
+  }
+
+  [[nodiscard]] int fifo_mode() const
+  {
+    return m_registers[fifo_ctrl_reg] >> 6;
+  }
+
+  [[nodiscard]] bool fifo_active() const
+  {
+    return fifo_enabled() && fifo_mode() != 0;
+  }
+
+  [[nodiscard]] hal::byte fifo_source() const
+  {
+    hal::byte value = 0;
+    auto const threshold = m_registers[fifo_ctrl_reg] & 0x1F;
+    if (m_fifo_count > static_cast<std::size_t>(threshold)) {
+      value |= (1 << 7);
+    }
+    if (m_fifo_count == fifo_depth) {
+      value |= (1 << 6);
+    }
+    if (m_fifo_count == 0) {
+      value |= (1 << 5);
+    }
+    value |= static_cast<hal::byte>(std::min<std::size_t>(m_fifo_count, 31));
+    return value;
+  }
+
+  [[nodiscard]] hal::byte status() const
+  {
+    if (fifo_active()) {
+      hal::byte value = 0;
+      if (m_fifo_count > 0) {
+        value |= 0x0F;
+      }
+      if (m_fifo_count == fifo_depth) {
+        value |= 0xF0;
+      }
+      return value;
+    }
+    return m_registers[status_reg];
+  }
+
+  [[nodiscard]] sample_bytes output_bytes() const
+  {
+    if (fifo_active()) {
+      if (m_fifo_count == 0) {
+        return m_latest;
+      }
+      return m_fifo[m_fifo_head];
+    }
+    return m_latest;
+  }
+
+  void consume_output()
+  {
+    if (fifo_active()) {
+      if (m_fifo_count > 0) {
+        m_fifo_head = (m_fifo_head + 1) % fifo_depth;
+        m_fifo_count--;
+      }
+      return;
+    }
+    m_registers[status_reg] = 0;
+  }
+
+  [[nodiscard]] sample_bytes encode(acceleration p_acceleration) const
+  {
+    auto const full_scale = (m_registers[ctrl_reg4] >> 4) & 0b11;
+    bool const high_resolution = m_registers[ctrl_reg4] & (1 << 3);
+    bool const low_power = m_registers[ctrl_reg1] & (1 << 3);
+
+    // sensitivity in mg/digit from the datasheet, indexed by full scale
+    constexpr std::array<float, 4> high_resolution_mg{ 1, 2, 4, 12 };
+    constexpr std::array<float, 4> normal_mg{ 4, 8, 16, 48 };
+    constexpr std::array<float, 4> low_power_mg{ 16, 32, 64, 192 };
+
+    int bits = 10;
+    float sensitivity = normal_mg[full_scale];
+    if (low_power) {
+      bits = 8;
+      sensitivity = low_power_mg[full_scale];
+    } else if (high_resolution) {
+      bits = 12;
+      sensitivity = high_resolution_mg[full_scale];
+    }
+
+    auto const limit = (1 << (bits - 1));
+    auto const convert = [&](float p_g) {
+      auto counts = static_cast<int>(std::lround(p_g * 1000.0f / sensitivity));
+      counts = std::clamp(counts, -limit, limit - 1);
+      auto const justified = static_cast<std::uint16_t>(
+        static_cast<std::int16_t>(counts * (1 << (16 - bits))));
+      return std::array{ static_cast<hal::byte>(justified & 0xFF),
+                         static_cast<hal::byte>(justified >> 8) };
+    };
+
+    auto const x = convert(p_acceleration.x);
+    auto const y = convert(p_acceleration.y);
+    auto const z = convert(p_acceleration.z);
+    return { x[0], x[1], y[0], y[1], z[0], z[1] };
+  }
+
+  void generate_sample()
+  {
+    acceleration value{};
+    if (m_generator) {
+      value = m_generator(m_sample_index);
+    }
+    m_sample_index++;
+    m_latest = encode(value);
+
+    auto& status_value = m_registers[status_reg];
+    if (status_value & (1 << 3)) {
+      status_value |= 0xF0;
+    }
+    status_value |= 0x0F;
+
+    if (not fifo_active()) {
+      return;
+    }
+
+    if (m_fifo_count == fifo_depth) {
+      // FIFO mode stops collecting once full, stream modes drop the oldest
+      if (fifo_mode() == 0b01) {
+        return;
+      }
+      m_fifo_head = (m_fifo_head + 1) % fifo_depth;
+      m_fifo_count--;
+    }
+    m_fifo[(m_fifo_head + m_fifo_count) % fifo_depth] = m_latest;
+    m_fifo_count++;
+  }
+
+  std::array<hal::byte, 0x40> m_registers{};
+  std::array<sample_bytes, fifo_depth> m_fifo{};
+  std::size_t m_fifo_head = 0;
+  std::size_t m_fifo_count = 0;
+  sample_bytes m_latest{};
+  generator m_generator{};
+  std::uint64_t m_sample_index = 0;
+  double m_elapsed = 0.0;
+};
+
+/**
+ * @brief I2C front end for lis3dh_simulator
+ *
+ * The first byte written is the register sub-address, bit 7 of which enables
+ * auto-increment. Any remaining written bytes are stored starting at that
+ * address, any bytes read are fetched starting at that address.
+ */
+class lis3dh_simulator_i2c : public hal::i2c
+{
+public:
+  lis3dh_simulator_i2c(lis3dh_simulator& p_device,
+                       hal::byte p_address = 0b0001'1000)
+    : m_device(&p_device)
+    , m_address(p_address)
+  {
+  }
+
+private:
+  void driver_configure(const settings&) override
+  {
+  }
+
+  void driver_transaction(
+    hal::byte p_address,
+    std::span<const hal::byte> p_data_out,
+    std::span<hal::byte> p_data_in,
+    hal::function_ref<hal::timeout_function>) override
+  {
+    if (p_address != m_address) {
+      hal::safe_throw(hal::no_such_device(p_address, this));
+    }
+
+    m_device->transactions++;
+    m_device->bytes += p_data_out.size() + p_data_in.size();
+
+    if (p_data_out.empty()) {
+      // a read without a sub-address continues from the last address
+      read_from(m_last_address, p_data_in);
+      return;
+    }
+
+    m_increment = p_data_out[0] & 0x80;
+    hal::byte address = p_data_out[0] & 0x7F;
+    for (auto const byte : p_data_out.subspan(1)) {
+      m_device->bus_write(address, byte);
+      address = step(address);
+    }
+    read_from(address, p_data_in);
+  }
+
+  void read_from(hal::byte p_address, std::span<hal::byte> p_data_in)
+  {
+    for (auto& byte : p_data_in) {
+      byte = m_device->bus_read(p_address);
+      p_address = step(p_address);
+    }
+    m_last_address = p_address;
+  }
+
+  hal::byte step(hal::byte p_address) const
+  {
+    return m_increment ? m_device->next_address(p_address) : p_address;
+  }
+
+  lis3dh_simulator* m_device;
+  hal::byte m_address;
+  hal::byte m_last_address = 0;
+  bool m_increment = false;
+};
+
+/**
+ * @brief SPI front end for lis3dh_simulator
+ *
+ * A transaction begins when the chip select is pulled low. The first byte
+ * clocked in is the command byte: bit 7 selects a read, bit 6 (MS) enables
+ * auto-increment and bits 5:0 hold the register address. The transaction may
+ * span any number of transfer() calls until chip select returns high.
+ */
+class lis3dh_simulator_spi
+  : public hal::spi
+  , public hal::output_pin
+{
+public:
+  explicit lis3dh_simulator_spi(lis3dh_simulator& p_device)
+    : m_device(&p_device)
+  {
+  }
+
+  /// Returns the chip select pin that frames transactions on this bus
+  hal::output_pin& chip_select()
+  {
+    return *this;
+  }
+
+  /// Number of times chip select has been asserted
+  std::size_t chip_selects = 0;
+  /// The board shares SDI as the only data line and leaves SDO unconnected
+  bool three_wire = false;
+  /// Number of bytes the host drove while the device was driving data out
+  /// on the shared data line
+  std::size_t contentions = 0;
+
+private:
+  void driver_configure(const hal::spi::settings&) override
+  {
+  }
+
+  void driver_configure(const hal::output_pin::settings&) override
+  {
+  }
+
+  void driver_level(bool p_high) override
+  {
+    if (not p_high && m_deselected) {
+      chip_selects++;
+      m_device->transactions++;
+      m_has_command = false;
+    }
+    m_deselected = p_high;
+  }
+
+  bool driver_level() override
+  {
+    return m_deselected;
+  }
+
+  void driver_transfer(std::span<const hal::byte> p_data_out,
+                       std::span<hal::byte> p_data_in,
+                       hal::byte p_filler) override
+  {
+    if (m_deselected) {
+      // the device ignores the bus while it is not selected
+      std::fill(p_data_in.begin(), p_data_in.end(), p_filler);
+      return;
+    }
+
+    m_device->transfers++;
+    auto const length = std::max(p_data_out.size(), p_data_in.size());
+    m_device->bytes += length;
+
+    for (std::size_t i = 0; i < length; i++) {
+      auto const mosi = i < p_data_out.size() ? p_data_out[i] : p_filler;
+      hal::byte miso = 0xFF;
+
+      if (not m_has_command) {
+        m_has_command = true;
+        m_read = mosi & 0x80;
+        m_increment = mosi & 0x40;
+        m_address = mosi & 0x3F;
+      } else if (m_read) {
+        auto const data = m_device->bus_read(m_address);
+        step();
+        // SIM selects which of SDI or SDO the device drives data out on
+        auto const sim = (m_device->reg(0x23) & 0x01) != 0;
+        if (sim == three_wire) {
+          miso = data;
+        }
+        if (three_wire && sim && not p_data_out.empty()) {
+          contentions++;
+        }
+      } else {
+        m_device->bus_write(m_address, mosi);
+        step();
+      }
+
+      if (i < p_data_in.size()) {
+        p_data_in[i] = miso;
+      }
+    }
+  }
+
+  void step()
+  {
+    if (m_increment) {
+      m_address = m_device->next_address(m_address) & 0x3F;
+    }
+  }
+
+  lis3dh_simulator* m_device;
+  bool m_deselected = true;
+  bool m_has_command = false;
+  bool m_read = false;
+  bool m_increment = false;
+  hal::byte m_address = 0;
+};
+
+/**
+ * @brief 1MHz steady clock that advances by a fixed step every time it is
+ * read, used to give timed calls a known latency
+ */
+class lis3dh_simulator_clock : public hal::steady_clock
+{
+public:
+  explicit lis3dh_simulator_clock(std::uint64_t p_step)
+    : m_step(p_step)
+  {
+  }
+
+private:
+  hal::hertz driver_frequency() override
+  {
+    return 1'000'000.0f;
+  }
+
+  std::uint64_t driver_uptime() override
+  {
+    m_uptime += m_step;
+    return m_uptime;
+  }
+
+  std::uint64_t m_step;
+  std::uint64_t m_uptime = 0;
+};
+}  // namespace hal::stm_imu
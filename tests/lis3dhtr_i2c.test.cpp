@@ -1,4 +1,4 @@
-// Copyright 2023 Google LLC
+// Copyright 2024 Khalil Estell
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -11,9 +11,17 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+
+#include <array>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
 #include <boost/ut.hpp>
 #include <libhal-stm-imu/lis3dhtr_i2c.hpp>
 
+#include "lis3dh_simulator.hpp"
+
 namespace hal::stm_imu {
 void lis3dhtr_i2c_test()
 {
@@ -22,8 +30,816 @@ void lis3dhtr_i2c_test()
 
   "lis3dhtr_i2c::create()"_test = []() {
     // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+
+    // Exercise
+    lis3dhtr_i2c lis(i2c);
+
+    // Verify
+    // WHO_AM_I read, a single CTRL_REG1..6 burst then FIFO_CTRL_REG
+    expect(that % 3U == device.transactions);
+    expect(that % 0x77 == device.reg(0x20));
+    expect(that % 0x00 == device.reg(0x23));
+  };
+
+  "lis3dhtr_i2c::create() over a configured device"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    // left behind by firmware that ran before an MCU only reset
+    device.reg(0x22) = 0x04;
+    device.reg(0x24) = 0x40;
+    device.reg(0x2E) = 0x9F;
+
     // Exercise
+    lis3dhtr_i2c lis(i2c);
+    auto const fifo_ctrl = device.reg(0x2E);
+    lis.configure_fifo_watermark(4);
+
+    // Verify
+    // every cached register is written, so later read-modify-writes of the
+    // cache match the device
+    expect(that % 0x00 == device.reg(0x22));
+    expect(that % 0x00 == device.reg(0x24));
+    expect(that % 0x00 == fifo_ctrl);
+    expect(that % 0x04 == device.reg(0x2E));
+  };
+
+  "lis3dhtr_i2c::create() low power over high resolution"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    // left in high resolution mode by firmware that ran before an MCU reset
+    device.reg(0x23) = 0x08;
+
+    // Exercise
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .mode = lis3dhtr_i2c::operating_mode::low_power,
+                     });
+
+    // Verify
+    expect(not device.lpen_and_hr_set);
+    expect(that % 0x7F == device.reg(0x20));
+    expect(that % 0x00 == device.reg(0x23));
+  };
+
+  "lis3dhtr_i2c::create() wrong device"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    device.reg(lis3dh_simulator::who_am_i) = 0x44;
+
+    // Exercise & Verify
+    expect(throws<hal::no_such_device>([&i2c]() { lis3dhtr_i2c lis(i2c); }));
+  };
+
+  "lis3dhtr_i2c::create() fast start"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    device.reg(lis3dh_simulator::who_am_i) = 0x44;
+
+    // Exercise
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{},
+                     lis3dhtr_i2c::fast_start);
+    auto const transactions = device.transactions;
+    auto const present = lis.device_present();
+
+    // Verify
+    // a single CTRL_REG1..6 burst, the wrong ID is only seen when checked
+    expect(that % 1U == transactions);
+    expect(that % 0x77 == device.reg(0x20));
+    expect(not present);
+    expect(throws<hal::no_such_device>([&lis]() { lis.verify_device(); }));
+  };
+
+  "lis3dhtr_i2c::create() fast start with the FIFO"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c::settings const settings{
+      .fifo = lis3dhtr_i2c::fifo_mode::stream,
+    };
+
+    // Exercise
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     settings,
+                     lis3dhtr_i2c::fast_start);
+    auto const transactions = device.transactions;
+
+    // Verify
+    // a CTRL_REG1..6 burst then FIFO_CTRL_REG
+    expect(that % 2U == transactions);
+    expect(that % 0x40 == device.reg(0x24));
+    expect(that % 0x80 == device.reg(0x2E));
+  };
+
+  "lis3dhtr_i2c::create() fast start ignores a kept FIFO mode"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    // stream mode kept through an MCU reset
+    device.reg(0x2E) = 0x80;
+
+    // Exercise
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{},
+                     lis3dhtr_i2c::fast_start);
+    device.advance_samples(3);
+    auto const fifo_count = device.fifo_count();
+    lis.configure_fifo_watermark(4);
+
+    // Verify
+    // FIFO_EN is clear, so the device samples as if bypassed
+    expect(that % 0U == fifo_count);
+    // the whole register is written with the cached bypass mode
+    expect(that % 0x04 == device.reg(0x2E));
+  };
+
+  "lis3dhtr_i2c::configure()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    lis.enable_watermark_interrupt(15);
+    device.transactions = 0;
+
+    // Exercise
+    lis.configure(lis3dhtr_i2c::settings{
+      .data_rate = lis3dhtr_i2c::data_rate_config::mode_9,
+      .full_scale = lis3dhtr_i2c::max_acceleration::g16,
+      .mode = lis3dhtr_i2c::operating_mode::low_power,
+      .fifo = lis3dhtr_i2c::fifo_mode::stream,
+    });
+    auto const transactions = device.transactions;
+    device.advance_samples(1);
+    auto const sample = lis.read_raw();
+
+    // Verify
+    // HR is cleared in CTRL_REG4 before LPen is set, then a single
+    // CTRL_REG1..6 burst and FIFO_CTRL_REG
+    expect(that % 3U == transactions);
+    expect(that % 0x9F == device.reg(0x20));
+    expect(that % 0x30 == device.reg(0x23));
+    expect(that % 0x40 == device.reg(0x24));
+    expect(that % 0x80 == device.reg(0x2E));
+    // the watermark interrupt is not part of settings and is turned off
+    expect(that % 0x00 == device.reg(0x22));
+    expect(that % 8 == sample.resolution);
+    expect(sample.full_scale == lis3dhtr_i2c::max_acceleration::g16);
+  };
+
+  "lis3dhtr_i2c::read()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.advance_samples(1);
+
+    // Exercise
+    auto const sample = lis.read();
+
+    // Verify
+    expect(std::abs(sample.x - 0.5f) < 0.001f) << sample.x;
+    expect(std::abs(sample.y + 1.0f) < 0.001f) << sample.y;
+    expect(std::abs(sample.z - 1.0f) < 0.001f) << sample.z;
+  };
+
+  "lis3dhtr_i2c_core::read()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c_core lis(
+      lis3dhtr_i2c_transport(i2c, lis3dhtr_i2c::low_address),
+      lis3dhtr_i2c_core::settings{});
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.advance_samples(1);
+    device.transactions = 0;
+
+    // Exercise
+    auto const sample = lis.read();
+
+    // Verify
+    expect(that % 1U == device.transactions);
+    expect(std::abs(sample.x - 0.5f) < 0.001f) << sample.x;
+    expect(std::abs(sample.y + 1.0f) < 0.001f) << sample.y;
+    expect(std::abs(sample.z - 1.0f) < 0.001f) << sample.z;
+  };
+
+  "lis3dhtr_i2c::configure_full_scale()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 1.5f, .y = -0.5f, .z = 1.0f };
+    });
+    std::array<hal::accelerometer::read_t, 4> samples{};
+
+    // Exercise
+    for (std::size_t code = 0; code < samples.size(); code++) {
+      using max_acceleration = lis3dhtr_i2c::max_acceleration;
+      lis.configure_full_scale(static_cast<max_acceleration>(code));
+      device.advance_samples(1);
+      samples[code] = lis.read();
+    }
+
+    // Verify
+    // the sensitivity follows the full scale, tolerance is one digit
+    constexpr std::array<float, 4> digit{ 0.004f, 0.008f, 0.016f, 0.048f };
+    for (std::size_t code = 0; code < samples.size(); code++) {
+      auto const& sample = samples[code];
+      expect(std::abs(sample.x - 1.5f) <= digit[code]) << sample.x;
+      expect(std::abs(sample.y + 0.5f) <= digit[code]) << sample.y;
+      expect(std::abs(sample.z - 1.0f) <= digit[code]) << sample.z;
+    }
+  };
+
+  "lis3dhtr_i2c::configure_operating_mode()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .mode = lis3dhtr_i2c::operating_mode::high_resolution,
+                     });
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.transactions = 0;
+
+    // Exercise
+    lis.configure_operating_mode(lis3dhtr_i2c::operating_mode::low_power);
+    auto const to_low_power = device.transactions;
+    device.advance_samples(1);
+    auto const low_power = lis.read_raw();
+    auto const low_power_g = lis.read();
+    device.transactions = 0;
+    lis.configure_operating_mode(lis3dhtr_i2c::operating_mode::high_resolution);
+    auto const to_high_resolution = device.transactions;
+    device.transactions = 0;
+    lis.configure_operating_mode(lis3dhtr_i2c::operating_mode::normal);
+    auto const to_normal = device.transactions;
+    device.advance_samples(1);
+    auto const normal = lis.read_raw();
+
+    // Verify
+    // both registers change when switching between low power and high
+    // resolution, only CTRL_REG4 when leaving high resolution for normal
+    expect(not device.lpen_and_hr_set);
+    expect(that % 2U == to_low_power);
+    expect(that % 2U == to_high_resolution);
+    expect(that % 1U == to_normal);
+    expect(that % 0x00 == device.reg(0x23));
+    expect(that % 0x77 == device.reg(0x20));
+    // 16 mg/digit at 2g in low power mode, 4 mg/digit in normal mode
+    expect(that % 8 == low_power.resolution);
+    expect(that % 31 == low_power.x);
+    expect(std::abs(low_power_g.y + 1.0f) < 0.016f) << low_power_g.y;
+    expect(that % 10 == normal.resolution);
+    expect(that % 125 == normal.x);
+  };
+
+  "lis3dhtr_i2c::configure_calibration()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .mode = lis3dhtr_i2c::operating_mode::high_resolution,
+                     });
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.advance_samples(1);
+
+    // Exercise
+    lis.configure_calibration(lis3dhtr_i2c::calibration_model{
+      .bias = { 0.1f, 0.0f, -0.25f },
+      .scale = { 2.0f, 1.0f, 0.5f },
+    });
+    auto const calibrated = lis.read();
+    // the calibration is folded again for the new sensitivity
+    lis.configure_full_scale(lis3dhtr_i2c::max_acceleration::g4);
+    device.advance_samples(1);
+    auto const rescaled = lis.read_with_status().acceleration;
+    lis.configure_calibration({});
+    auto const uncalibrated = lis.read();
+
+    // Verify
+    expect(std::abs(calibrated.x - 0.8f) < 0.001f) << calibrated.x;
+    expect(std::abs(calibrated.y + 1.0f) < 0.001f) << calibrated.y;
+    expect(std::abs(calibrated.z - 0.625f) < 0.001f) << calibrated.z;
+    expect(std::abs(rescaled.x - 0.8f) < 0.001f) << rescaled.x;
+    expect(std::abs(rescaled.z - 0.625f) < 0.001f) << rescaled.z;
+    expect(std::abs(uncalibrated.x - 0.5f) < 0.001f) << uncalibrated.x;
+    expect(that % 1.0f == lis.calibration().scale[0]);
+  };
+
+  "lis3dhtr_i2c::configure_calibration() cross axis"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.advance_samples(1);
+
+    // Exercise
+    // a board mounted with x and y swapped, and z leaking into x
+    lis.configure_calibration(lis3dhtr_i2c::calibration_model{
+      .cross_axis = { {
+        { 0.0f, 1.0f, 0.5f },
+        { 1.0f, 0.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f },
+      } },
+    });
+    auto const sample = lis.read();
+
+    // Verify
+    expect(std::abs(sample.x + 0.5f) < 0.001f) << sample.x;
+    expect(std::abs(sample.y - 0.5f) < 0.001f) << sample.y;
+    expect(std::abs(sample.z - 1.0f) < 0.001f) << sample.z;
+  };
+
+  "lis3dhtr::milli_g_per_digit()"_test = []() {
+    // Setup
+    using enum lis3dhtr::max_acceleration;
+
+    // Exercise & Verify
+    // datasheet sensitivities for high resolution, normal and low power
+    expect(that % 1 == lis3dhtr::milli_g_per_digit(g2, 12));
+    expect(that % 4 == lis3dhtr::milli_g_per_digit(g2, 10));
+    expect(that % 16 == lis3dhtr::milli_g_per_digit(g2, 8));
+    expect(that % 12 == lis3dhtr::milli_g_per_digit(g16, 12));
+    expect(that % 48 == lis3dhtr::milli_g_per_digit(g16, 10));
+    expect(that % 192 == lis3dhtr::milli_g_per_digit(g16, 8));
+  };
+
+  "lis3dhtr::convert()"_test = []() {
+    // Setup
+    lis3dhtr::raw_read_t const raw{
+      .x = 125,
+      .y = -250,
+      .z = 0,
+      .full_scale = lis3dhtr::max_acceleration::g4,
+      .resolution = 10,
+    };
+
+    // Exercise
+    auto const sample = lis3dhtr::convert(raw);
+
+    // Verify
+    // 8 mg/digit at 4g in normal mode
+    expect(std::abs(sample.x - 1.0f) < 0.0001f) << sample.x;
+    expect(std::abs(sample.y + 2.0f) < 0.0001f) << sample.y;
+    expect(std::abs(sample.z) < 0.0001f) << sample.z;
+  };
+
+  "lis3dhtr::convert() with a calibration"_test = []() {
+    // Setup
+    lis3dhtr::calibration_model model{};
+    model.bias = { 0.1f, 0.0f, 0.0f };
+    model.scale = { 2.0f, 1.0f, 1.0f };
+    model.cross_axis[0][1] = 0.5f;
+    lis3dhtr::raw_read_t const raw{
+      .x = 1000,
+      .y = -500,
+      .z = 250,
+      .full_scale = lis3dhtr::max_acceleration::g2,
+      .resolution = 12,
+    };
+
+    // Exercise
+    auto const conversion = lis3dhtr::conversion_for(
+      model, lis3dhtr::max_acceleration::g2, 12);
+    auto const sample = lis3dhtr::convert(raw, conversion);
+
+    // Verify
+    // x = 2 * (1g - 0.1g) + 0.5 * -0.5g
+    expect(that % true == conversion.cross_axis);
+    expect(std::abs(sample.x - 1.55f) < 0.0001f) << sample.x;
+    expect(std::abs(sample.y + 0.5f) < 0.0001f) << sample.y;
+    expect(std::abs(sample.z - 0.25f) < 0.0001f) << sample.z;
+  };
+
+  "lis3dhtr_i2c::read_raw() high resolution"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .full_scale = lis3dhtr_i2c::max_acceleration::g4,
+                       .mode = lis3dhtr_i2c::operating_mode::high_resolution,
+                     });
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 1.0f, .y = 0.0f, .z = -2.0f };
+    });
+    device.advance_samples(1);
+
+    // Exercise
+    auto const sample = lis.read_raw();
+
+    // Verify
+    // 2 mg/digit at 4g in high resolution mode
+    expect(that % 500 == sample.x);
+    expect(that % 0 == sample.y);
+    expect(that % -1000 == sample.z);
+    expect(that % 12 == sample.resolution);
+  };
+
+  "lis3dhtr_i2c::read_with_status()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+
+    // Exercise
+    device.advance_samples(1);
+    auto const fresh = lis.read_with_status();
+    auto const repeated = lis.read_with_status();
+    device.advance_samples(2);
+    auto const overrun = lis.read_with_status();
+
+    // Verify
+    expect(fresh.new_data && not fresh.overrun);
+    expect(not repeated.new_data && not repeated.overrun);
+    expect(overrun.new_data && overrun.overrun);
+  };
+
+  "lis3dhtr_i2c::read_with_status() single burst"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.advance_samples(1);
+    device.transactions = 0;
+    device.bytes = 0;
+
+    // Exercise
+    auto const status = lis.read_with_status();
+
+    // Verify
+    // register address, then STATUS_REG and the six output registers read
+    // in one transaction
+    expect(that % 1U == device.transactions);
+    expect(that % 8U == device.bytes);
+    expect(status.new_data);
+    expect(std::abs(status.acceleration.x - 0.5f) < 0.001f)
+      << status.acceleration.x;
+    expect(std::abs(status.acceleration.y + 1.0f) < 0.001f)
+      << status.acceleration.y;
+    expect(std::abs(status.acceleration.z - 1.0f) < 0.001f)
+      << status.acceleration.z;
+  };
+
+  "lis3dhtr_i2c::read_fifo()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .fifo = lis3dhtr_i2c::fifo_mode::stream,
+                     });
+    device.source([](std::uint64_t p_index) {
+      return lis3dh_simulator::acceleration{
+        .x = 0.0f, .y = 0.0f, .z = static_cast<float>(p_index) * 0.004f
+      };
+    });
+    device.advance_samples(40);
+    std::array<lis3dhtr_i2c::raw_read_t, lis3dhtr_i2c::fifo_depth> samples{};
+    auto const transactions_before = device.transactions;
+
+    // Exercise
+    auto const drained = lis.read_fifo(samples);
+    auto const transactions = device.transactions - transactions_before;
+    auto const empty = lis.read_fifo(samples);
+
+    // Verify
+    expect(that % lis3dhtr_i2c::fifo_depth == drained.size());
+    // stream mode keeps the newest 32 of the 40 samples
+    expect(that % 8 == drained.front().z);
+    expect(that % 39 == drained.back().z);
+    // FIFO_SRC read followed by one burst of every sample
+    expect(that % 2U == transactions);
+    expect(that % 0U == empty.size());
+  };
+
+  "lis3dhtr_i2c::configure_fifo()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    device.source([](std::uint64_t p_index) {
+      return lis3dh_simulator::acceleration{
+        .x = 0.0f, .y = 0.0f, .z = static_cast<float>(p_index) * 0.004f
+      };
+    });
+    std::array<lis3dhtr_i2c::raw_read_t, 20> samples{};
+
+    // Exercise
+    lis.configure_fifo(lis3dhtr_i2c::fifo_mode::fifo);
+    device.advance_samples(40);
+    auto const first = lis.read_fifo(samples);
+    auto const first_front = first.front().z;
+    auto const second = lis.read_fifo(samples);
+    auto const second_back = second.back().z;
+    device.advance_samples(4);
+    lis.configure_fifo(lis3dhtr_i2c::fifo_mode::bypass);
+    auto const after_bypass = device.fifo_count();
+
+    // Verify
+    // fifo mode stops collecting once full, so only the first 32 samples are
+    // kept. A buffer smaller than the FIFO leaves the rest for the next call.
+    expect(that % 20U == first.size());
+    expect(that % 0 == first_front);
+    expect(that % 12U == second.size());
+    expect(that % 31 == second_back);
+    expect(that % 0U == after_bypass);
+  };
+
+  "lis3dhtr_i2c::create() warm restart"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    {
+      lis3dhtr_i2c lis(i2c,
+                       lis3dhtr_i2c::low_address,
+                       lis3dhtr_i2c::settings{
+                         .data_rate = lis3dhtr_i2c::data_rate_config::mode_5,
+                         .full_scale = lis3dhtr_i2c::max_acceleration::g8,
+                         .mode = lis3dhtr_i2c::operating_mode::high_resolution,
+                         .fifo = lis3dhtr_i2c::fifo_mode::stream,
+                       });
+    }
+    device.source([](std::uint64_t p_index) {
+      return lis3dh_simulator::acceleration{
+        .x = 0.0f, .y = 0.0f, .z = static_cast<float>(p_index) * 0.004f
+      };
+    });
+    device.advance_samples(10);
+    auto const transactions_before = device.transactions;
+    std::array<lis3dhtr_i2c::raw_read_t, lis3dhtr_i2c::fifo_depth> samples{};
+
+    // Exercise
+    lis3dhtr_i2c lis(
+      i2c, lis3dhtr_i2c::low_address, lis3dhtr_i2c::warm_restart);
+    auto const transactions = device.transactions - transactions_before;
+    auto const adopted = lis.adopt_configuration();
+    auto const drained = lis.read_fifo(samples);
+
+    // Verify
+    // control block burst then FIFO_CTRL_REG, nothing written
+    expect(that % 2U == transactions);
+    expect(adopted.data_rate == lis3dhtr_i2c::data_rate_config::mode_5);
+    expect(adopted.full_scale == lis3dhtr_i2c::max_acceleration::g8);
+    expect(adopted.mode == lis3dhtr_i2c::operating_mode::high_resolution);
+    expect(adopted.fifo == lis3dhtr_i2c::fifo_mode::stream);
+    // the samples buffered before the restart are all still there
+    expect(that % 10U == drained.size());
+    expect(that % 12 == drained.front().resolution);
+    // 4 mg/digit at 8g in high resolution mode
+    expect(that % 0 == drained.front().z);
+    expect(that % 9 == drained.back().z);
+  };
+
+  "lis3dhtr_i2c::read_fifo() timestamped"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .fifo = lis3dhtr_i2c::fifo_mode::stream,
+                     });
+    lis3dh_simulator_clock clock(1'000'000);
+    std::array<lis3dhtr_i2c::timestamped_read_t, lis3dhtr_i2c::fifo_depth>
+      samples{};
+    device.advance_samples(5);
+
+    // Exercise
+    auto const drained = lis.read_fifo(samples, clock);
+
+    // Verify
+    // 2500 ticks per sample at 400Hz, the newest sample is stamped half a
+    // period before the FIFO count was read at tick 1'000'000
+    expect(that % 5U == drained.size());
+    expect(that % 998'750U == drained.back().ticks);
+    expect(that % 988'750U == drained.front().ticks);
+  };
+
+  "lis3dhtr_i2c::read_fifo() timestamped from watermark"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    lis3dh_simulator_clock clock(1'000'000);
+    std::array<lis3dhtr_i2c::timestamped_read_t, lis3dhtr_i2c::fifo_depth>
+      samples{};
+    lis.enable_watermark_interrupt(15);
+
+    // Exercise
+    device.advance_samples(16);
+    auto const watermark_ticks = device.int1() ? clock.uptime() : 0;
+    device.advance_samples(3);
+    auto const drained = lis.read_fifo(samples, clock, watermark_ticks);
+
+    // Verify
+    // the 16th sample raised the watermark signal
+    expect(that % 19U == drained.size());
+    expect(that % 1'000'000U == drained[15].ticks);
+    expect(that % 962'500U == drained.front().ticks);
+    expect(that % 1'007'500U == drained.back().ticks);
+  };
+
+  "lis3dhtr_i2c::read_fifo() with sample_rate_estimator"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .fifo = lis3dhtr_i2c::fifo_mode::stream,
+                     });
+    lis3dh_simulator_clock clock(1'000'000);
+    sample_rate_estimator estimator(400.0f, clock.frequency());
+    std::array<lis3dhtr_i2c::timestamped_read_t, lis3dhtr_i2c::fifo_depth>
+      samples{};
+
+    // Exercise
+    device.advance_samples(5);
+    auto const first = lis.read_fifo(samples, clock, estimator);
+    auto const first_back = first.back().ticks;
+    device.advance_samples(3);
+    auto const second = lis.read_fifo(samples, clock, estimator);
+
+    // Verify
+    // the first drain anchors the fit with the nominal period
+    expect(that % 5U == first.size());
+    expect(that % 998'750U == first_back);
+    expect(that % 3U == second.size());
+    expect(that % 2U == estimator.updates());
+    expect(that % 8U == estimator.next_index());
+    expect(second.front().ticks > first_back);
+  };
+
+  "lis3dhtr_i2c::enable_watermark_interrupt()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    std::array<lis3dhtr_i2c::raw_read_t, lis3dhtr_i2c::fifo_depth> samples{};
+
+    // Exercise
+    lis.enable_watermark_interrupt(15);
+    device.advance_samples(15);
+    bool const below_watermark = device.int1();
+    device.advance_samples(1);
+    bool const above_watermark = device.int1();
+    auto const drained = lis.read_fifo(samples);
+    bool const after_drain = device.int1();
+
+    // Verify
+    expect(not below_watermark);
+    expect(above_watermark);
+    expect(that % 16U == drained.size());
+    expect(not after_drain);
+  };
+
+  "lis3dhtr_i2c::read_fifo() with adaptive_watermark"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dh_simulator_clock clock(5);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .fifo = lis3dhtr_i2c::fifo_mode::stream,
+                     });
+    adaptive_watermark policy;
+    bus_metrics metrics;
+    std::array<lis3dhtr_i2c::raw_read_t, lis3dhtr_i2c::fifo_depth> samples{};
+    device.advance_samples(10);
+
+    // Exercise
+    lis.attach_metrics(metrics, clock);
+    auto const drained = lis.read_fifo(samples, policy);
+
+    // Verify
+    expect(that % 10U == drained.size());
+    expect(that % policy.watermark() == (device.reg(0x2E) & 0x1F));
+    // the watermark write is timed as a configuration change, not as part
+    // of the read
+    expect(that % 1U == metrics.read_latency.count());
+    expect(that % 5U == metrics.read_latency.max());
+    expect(that % 1U == metrics.configure_latency.count());
+  };
+
+  "lis3dhtr_i2c::handle_data_ready()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    std::array<lis3dhtr_i2c::raw_read_t, 4> storage{};
+    spsc_ring_buffer<lis3dhtr_i2c::raw_read_t> buffer(storage);
+    std::array<lis3dhtr_i2c::raw_read_t, 4> samples{};
+    lis3dh_simulator_clock clock(5);
+    bus_metrics metrics;
+    lis.enable_data_ready_interrupt(buffer);
+    lis.attach_metrics(metrics, clock);
+
+    // Exercise
+    for (int i = 0; i < 5; i++) {
+      device.advance_samples(1);
+      if (device.int1()) {
+        lis.handle_data_ready();
+      }
+    }
+    auto const buffered = lis.read_buffered(samples);
+
+    // Verify
+    // every slot of the storage is used, the fifth sample is dropped
+    expect(that % 4U == buffered.size());
+    expect(not device.int1());
+    // the interrupt path leaves the metrics alone
+    expect(that % 0U == metrics.transactions);
+    expect(that % 0U == metrics.read_latency.count());
+  };
+
+  "lis3dhtr_i2c::lis3dhtr_i2c() copy and move"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dhtr_i2c lis(i2c);
+    device.source([](std::uint64_t) {
+      return lis3dh_simulator::acceleration{ .x = 0.5f, .y = -1.0f, .z = 1.0f };
+    });
+    device.advance_samples(1);
+
+    // Exercise
+    auto copy = lis;
+    auto moved = std::move(copy);
+    auto const sample = moved.read();
+
+    // Verify
+    expect(std::is_copy_assignable_v<lis3dhtr_i2c>);
+    expect(std::is_nothrow_move_assignable_v<lis3dhtr_i2c>);
+    expect(std::abs(sample.x - 0.5f) < 0.001f) << sample.x;
+  };
+
+  "lis3dhtr_i2c::attach_metrics()"_test = []() {
+    // Setup
+    lis3dh_simulator device;
+    lis3dh_simulator_i2c i2c(device);
+    lis3dh_simulator_clock clock(5);
+    lis3dhtr_i2c lis(i2c,
+                     lis3dhtr_i2c::low_address,
+                     lis3dhtr_i2c::settings{
+                       .fifo = lis3dhtr_i2c::fifo_mode::stream,
+                     });
+    bus_metrics metrics;
+    std::array<lis3dhtr_i2c::raw_read_t, lis3dhtr_i2c::fifo_depth> samples{};
+
+    // Exercise
+    lis.attach_metrics(metrics, clock);
+    lis.read_raw();
+    lis.configure_full_scale(lis3dhtr_i2c::max_acceleration::g8);
+    device.advance_samples(lis3dhtr_i2c::fifo_depth);
+    lis.read_fifo(samples);
+    lis.detach_metrics();
+    lis.read_raw();
+
     // Verify
+    // sample read, CTRL_REG4 write, FIFO_SRC read and FIFO burst
+    expect(that % 4U == metrics.transactions);
+    expect(that % (7U + 2U + 2U + 193U) == metrics.bytes);
+    expect(that % 0U == metrics.chip_selects);
+    expect(that % 1U == metrics.fifo_overruns);
+    expect(that % 2U == metrics.read_latency.count());
+    expect(that % 1U == metrics.configure_latency.count());
+    // 5us between clock reads lands in the [4us, 8us) bucket
+    expect(that % 2U == metrics.read_latency.buckets()[3]);
+    expect(that % 5U == metrics.read_latency.max());
   };
 };
-}  // namespace hal::stm_imu
\ No newline at end of file
+}  // namespace hal::stm_imu
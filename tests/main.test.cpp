@@ -13,12 +13,28 @@
 // limitations under the License.
 
 namespace hal::stm_imu {
+extern void adaptive_watermark_test();
+extern void decimator_test();
+extern void goertzel_test();
 extern void lis3dhtr_i2c_test();
 extern void lis3dhtr_spi_test();
+extern void sample_rate_estimator_test();
+extern void six_position_calibration_test();
+extern void spsc_ring_buffer_test();
+extern void streaming_statistics_test();
+extern void vibration_spectrum_test();
 }  // namespace hal::stm_imu
 
 int main()
 {
+  hal::stm_imu::adaptive_watermark_test();
+  hal::stm_imu::decimator_test();
+  hal::stm_imu::goertzel_test();
   hal::stm_imu::lis3dhtr_i2c_test();
   hal::stm_imu::lis3dhtr_spi_test();
+  hal::stm_imu::sample_rate_estimator_test();
+  hal::stm_imu::six_position_calibration_test();
+  hal::stm_imu::spsc_ring_buffer_test();
+  hal::stm_imu::streaming_statistics_test();
+  hal::stm_imu::vibration_spectrum_test();
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstdint>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/sample_rate_estimator.hpp>
+
+namespace hal::stm_imu {
+namespace {
+/**
+ * @brief Feeds p_estimator one observation per drain of 32 samples from a
+ * device running at p_true_rate, with the tick of each observation spread
+ * over one sample period
+ */
+void observe(sample_rate_estimator& p_estimator,
+             double p_true_rate,
+             int p_drains)
+{
+  auto const period = 1e6 / p_true_rate;
+  std::uint32_t random = 1;
+  for (int drain = 0; drain < p_drains; drain++) {
+    std::uint64_t const index = 31 + 32ULL * drain;
+    random = random * 1664525U + 1013904223U;
+    auto const jitter = ((random >> 8) / double(1 << 24) - 0.5) * period;
+    auto const acquired = static_cast<double>(index) * period + jitter;
+    p_estimator.update(index, 1'000'000 + static_cast<std::uint64_t>(acquired));
+  }
+}
+}  // namespace
+
+void sample_rate_estimator_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "sample_rate_estimator::sample_rate() nominal"_test = []() {
+    // Setup & Exercise
+    sample_rate_estimator estimator(400.0f, 1'000'000.0f);
+
+    // Verify
+    expect(that % 2500.0f == estimator.ticks_per_sample());
+    expect(that % 0U == estimator.updates());
+  };
+
+  "sample_rate_estimator::update() converges on drift"_test = []() {
+    // Setup
+    sample_rate_estimator estimator(400.0f, 1'000'000.0f);
+
+    // Exercise
+    // the device runs 1% fast
+    observe(estimator, 404.0, 500);
+
+    // Verify
+    expect(std::abs(estimator.sample_rate() - 404.0f) < 0.01f)
+      << estimator.sample_rate();
+    expect(std::abs(estimator.drift() - 0.01f) < 0.0001f) << estimator.drift();
+    // the timestamp mapping is far tighter than the half period jitter of
+    // the observations
+    auto const index = 31 + 32ULL * 499;
+    auto const expected = 1'000'000 + static_cast<std::int64_t>(
+                                        static_cast<double>(index) * 1e6 / 404);
+    auto const error =
+      static_cast<std::int64_t>(estimator.ticks(index)) - expected;
+    expect(std::abs(error) < 250) << error;
+  };
+
+  "sample_rate_estimator::resynchronize()"_test = []() {
+    // Setup
+    sample_rate_estimator estimator(400.0f, 1'000'000.0f);
+    observe(estimator, 404.0, 500);
+    auto const period = estimator.ticks_per_sample();
+
+    // Exercise
+    estimator.resynchronize();
+    estimator.update(100'000, 50'000'000);
+
+    // Verify
+    // the new observation anchors the fit and the period is kept
+    expect(that % 50'000'000U == estimator.ticks(100'000));
+    expect(that % period == estimator.ticks_per_sample());
+  };
+
+  "sample_rate_estimator::advance()"_test = []() {
+    // Setup
+    sample_rate_estimator estimator(400.0f, 1'000'000.0f);
+
+    // Exercise
+    estimator.advance(5);
+    estimator.advance(27);
+
+    // Verify
+    expect(that % 32U == estimator.next_index());
+  };
+};
+}  // namespace hal::stm_imu
@@ -0,0 +1,218 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/six_position_calibration.hpp>
+
+namespace hal::stm_imu {
+namespace {
+using vector3 = std::array<float, 3>;
+using matrix3 = std::array<vector3, 3>;
+
+/// a device whose readings are response * g + bias
+struct imperfect_device
+{
+  matrix3 response;
+  vector3 bias;
+
+  std::vector<lis3dhtr::raw_read_t> capture(vector3 p_gravity,
+                                            float p_noise = 0.001f) const
+  {
+    std::vector<lis3dhtr::raw_read_t> samples(64);
+    for (std::size_t n = 0; n < samples.size(); n++) {
+      std::array<std::int16_t, 3> digits{};
+      for (std::size_t row = 0; row < 3; row++) {
+        auto reading = bias[row];
+        for (std::size_t column = 0; column < 3; column++) {
+          reading += response[row][column] * p_gravity[column];
+        }
+        // alternating noise keeps the mean exact
+        reading += n % 2 == 0 ? p_noise : -p_noise;
+        // 1mg per digit
+        digits[row] = static_cast<std::int16_t>(std::lround(reading * 1000));
+      }
+      samples[n] = lis3dhtr::raw_read_t{
+        .x = digits[0],
+        .y = digits[1],
+        .z = digits[2],
+        .full_scale = lis3dhtr::max_acceleration::g2,
+        .resolution = 12,
+      };
+    }
+    return samples;
+  }
+
+  void capture_all(six_position_calibration& p_calibration) const
+  {
+    for (std::size_t axis = 0; axis < 3; axis++) {
+      for (float const sign : { 1.0f, -1.0f }) {
+        vector3 gravity{};
+        gravity[axis] = sign;
+        p_calibration.add_capture(capture(gravity));
+      }
+    }
+  }
+};
+
+/// the largest error of the calibrated readings over a few orientations
+float worst_error(imperfect_device const& p_device,
+                  lis3dhtr::calibration_model const& p_model)
+{
+  std::array<vector3, 4> const orientations{ {
+    { 0.6f, 0.0f, 0.8f },
+    { 0.0f, -0.8f, 0.6f },
+    { -0.48f, 0.6f, -0.64f },
+    { 1.0f, 0.0f, 0.0f },
+  } };
+
+  float worst = 0.0f;
+  for (auto const& gravity : orientations) {
+    vector3 corrected{};
+    for (std::size_t column = 0; column < 3; column++) {
+      float reading = p_device.bias[column];
+      for (std::size_t k = 0; k < 3; k++) {
+        reading += p_device.response[column][k] * gravity[k];
+      }
+      corrected[column] =
+        (reading - p_model.bias[column]) * p_model.scale[column];
+    }
+    for (std::size_t row = 0; row < 3; row++) {
+      float calibrated = 0.0f;
+      for (std::size_t column = 0; column < 3; column++) {
+        calibrated += p_model.cross_axis[row][column] * corrected[column];
+      }
+      worst = std::max(worst, std::abs(calibrated - gravity[row]));
+    }
+  }
+  return worst;
+}
+}  // namespace
+
+void six_position_calibration_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "six_position_calibration::compute() bias and scale"_test = []() {
+    // Setup
+    imperfect_device const device{
+      .response = { { { 1.02f, 0.0f, 0.0f },
+                      { 0.0f, 0.97f, 0.0f },
+                      { 0.0f, 0.0f, 1.01f } } },
+      .bias = { 0.03f, -0.02f, 0.05f },
+    };
+    six_position_calibration test_subject;
+    device.capture_all(test_subject);
+
+    // Exercise
+    auto const result = test_subject.compute();
+
+    // Verify
+    expect(that % true == test_subject.complete());
+    expect(that % true == result.has_value());
+    auto const model = result.value_or(lis3dhtr::calibration_model{});
+    expect(std::abs(model.bias[0] - 0.03f) < 0.001f) << model.bias[0];
+    expect(std::abs(model.bias[2] - 0.05f) < 0.001f) << model.bias[2];
+    expect(std::abs(model.scale[1] - 1.0f / 0.97f) < 0.002f)
+      << model.scale[1];
+    expect(that % 0.0f == model.cross_axis[0][1]);
+    expect(worst_error(device, model) < 0.002f);
+  };
+
+  "six_position_calibration::compute() cross axis"_test = []() {
+    // Setup
+    imperfect_device const device{
+      .response = { { { 1.02f, 0.03f, -0.02f },
+                      { 0.02f, 0.97f, 0.04f },
+                      { -0.03f, 0.01f, 1.01f } } },
+      .bias = { 0.03f, -0.02f, 0.05f },
+    };
+    six_position_calibration test_subject;
+    device.capture_all(test_subject);
+
+    // Exercise
+    auto const aligned = test_subject.compute();
+    auto const coupled = test_subject.compute(true);
+
+    // Verify
+    expect(that % true == aligned.has_value());
+    expect(that % true == coupled.has_value());
+    if (aligned && coupled) {
+      expect(worst_error(device, *aligned) > 0.02f);
+      expect(worst_error(device, *coupled) < 0.002f)
+        << worst_error(device, *coupled);
+    }
+  };
+
+  "six_position_calibration::compute() rejects a near singular response"_test =
+    []() {
+      // Setup
+      // each capture passes add_capture(), but normalized to 1 on the
+      // diagonal the response has a determinant of 0.38
+      imperfect_device const device{
+        .response = { { { 0.72f, 0.29f, -0.29f },
+                        { 0.29f, 0.72f, 0.29f },
+                        { -0.29f, 0.29f, 0.72f } } },
+        .bias = { 0.0f, 0.0f, 0.0f },
+      };
+      six_position_calibration test_subject;
+      device.capture_all(test_subject);
+
+      // Exercise
+      auto const aligned = test_subject.compute();
+      auto const coupled = test_subject.compute(true);
+
+      // Verify
+      expect(that % true == test_subject.complete());
+      expect(that % true == aligned.has_value());
+      expect(that % false == coupled.has_value());
+    };
+
+  "six_position_calibration::add_capture() rejects bad captures"_test =
+    []() {
+      // Setup
+      imperfect_device const device{
+        .response = { { { 1.0f, 0.0f, 0.0f },
+                        { 0.0f, 1.0f, 0.0f },
+                        { 0.0f, 0.0f, 1.0f } } },
+        .bias = { 0.0f, 0.0f, 0.0f },
+      };
+      six_position_calibration test_subject;
+
+      // Exercise
+      auto const moving = test_subject.add_capture(
+        device.capture({ 0.0f, 0.0f, 1.0f }, 0.1f));
+      auto const tilted =
+        test_subject.add_capture(device.capture({ 0.0f, 0.6f, 0.8f }));
+      auto const level =
+        test_subject.add_capture(device.capture({ 0.0f, 0.0f, -1.0f }));
+
+      // Verify
+      expect(that % false == moving);
+      expect(that % false == tilted);
+      expect(that % true == level);
+      using orientation = six_position_calibration::orientation;
+      expect(that % true == test_subject.captured(orientation::z_negative));
+      expect(that % false == test_subject.captured(orientation::z_positive));
+      expect(that % false == test_subject.complete());
+      // incomplete captures give no calibration
+      expect(that % false == test_subject.compute().has_value());
+    };
+};
+}  // namespace hal::stm_imu
@@ -0,0 +1,140 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cstddef>
+#include <thread>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/spsc_ring_buffer.hpp>
+
+namespace hal::stm_imu {
+void spsc_ring_buffer_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "spsc_ring_buffer::push() & pop_batch()"_test = []() {
+    // Setup
+    std::array<int, 4> storage{};
+    spsc_ring_buffer<int> buffer(storage);
+    std::array<int, 4> output{};
+
+    // Exercise
+    bool const first = buffer.push(1);
+    bool const second = buffer.push(2);
+    bool const third = buffer.push(3);
+    bool const fourth = buffer.push(4);
+    bool const overflow = buffer.push(5);
+    auto const popped = buffer.pop_batch(output);
+
+    // Verify
+    expect(first && second && third && fourth);
+    expect(not overflow);
+    expect(that % 4U == buffer.capacity());
+    expect(that % 4U == popped.size());
+    expect(that % 1 == popped[0]);
+    expect(that % 2 == popped[1]);
+    expect(that % 3 == popped[2]);
+    expect(that % 4 == popped[3]);
+    expect(that % 0U == buffer.size());
+  };
+
+  "spsc_ring_buffer::pop_batch() wraps around"_test = []() {
+    // Setup
+    std::array<int, 4> storage{};
+    spsc_ring_buffer<int> buffer(storage);
+    std::array<int, 2> output{};
+    buffer.push(1);
+    buffer.push(2);
+    buffer.pop_batch(output);
+
+    // Exercise
+    buffer.push(3);
+    buffer.push(4);
+    buffer.push(5);
+    auto const size = buffer.size();
+    auto const first = buffer.pop_batch(output);
+    auto const first_value = first[1];
+    auto const second = buffer.pop_batch(output);
+
+    // Verify
+    expect(that % 3U == size);
+    expect(that % 2U == first.size());
+    expect(that % 4 == first_value);
+    expect(that % 1U == second.size());
+    expect(that % 5 == second[0]);
+  };
+
+  "spsc_ring_buffer::assign() non power of two storage"_test = []() {
+    // Setup
+    std::array<int, 6> storage{};
+    spsc_ring_buffer<int> buffer;
+
+    // Exercise
+    buffer.assign(storage);
+
+    // Verify
+    expect(that % 4U == buffer.capacity());
+  };
+
+  "spsc_ring_buffer::pop_batch() concurrent producer"_test = []() {
+    // Setup
+    constexpr int count = 200'000;
+    std::array<int, 64> storage{};
+    spsc_ring_buffer<int> buffer(storage);
+    std::array<int, 16> batch{};
+    int expected = 0;
+    bool in_order = true;
+
+    // Exercise
+    std::thread producer([&buffer]() {
+      for (int i = 0; i < count; i++) {
+        while (not buffer.push(i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    while (expected < count) {
+      auto const popped = buffer.pop_batch(batch);
+      if (popped.empty()) {
+        std::this_thread::yield();
+      }
+      for (auto const value : popped) {
+        in_order = in_order && value == expected;
+        expected++;
+      }
+    }
+    producer.join();
+
+    // Verify
+    // every element arrives exactly once and in the order it was pushed
+    expect(in_order);
+    expect(that % count == expected);
+    expect(that % 0U == buffer.size());
+  };
+
+  "spsc_ring_buffer::push() without storage"_test = []() {
+    // Setup
+    spsc_ring_buffer<int> buffer;
+
+    // Exercise
+    bool const pushed = buffer.push(1);
+
+    // Verify
+    expect(not pushed);
+    expect(that % 0U == buffer.capacity());
+  };
+};
+}  // namespace hal::stm_imu
@@ -0,0 +1,202 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/streaming_statistics.hpp>
+
+namespace hal::stm_imu {
+namespace {
+lis3dhtr::raw_read_t sample(
+  std::int16_t p_x,
+  lis3dhtr::max_acceleration p_full_scale = lis3dhtr::max_acceleration::g2)
+{
+  return lis3dhtr::raw_read_t{
+    .x = p_x,
+    .y = static_cast<std::int16_t>(-p_x),
+    .z = 1000,
+    .full_scale = p_full_scale,
+    .resolution = 12,
+  };
+}
+}  // namespace
+
+void streaming_statistics_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "welford_accumulator::add()"_test = []() {
+    // Setup
+    welford_accumulator test_subject;
+
+    // Exercise
+    for (std::int16_t const x : { 2, 4, 4, 4, 5, 5, 7, 9 }) {
+      test_subject.add(sample(x));
+    }
+
+    // Verify
+    auto const& x = test_subject.axis(0);
+    expect(that % 8U == test_subject.count());
+    expect(std::abs(x.mean - 5.0f) < 1e-5f) << x.mean;
+    expect(std::abs(x.m2 - 32.0f) < 1e-4f) << x.m2;
+    expect(that % 2 == x.min);
+    expect(that % 9 == x.max);
+    expect(that % -9 == test_subject.axis(1).min);
+    expect(std::abs(test_subject.axis(2).m2) < 1e-6f);
+    // y mirrors x
+    expect(std::abs(test_subject.co_moment(0, 1) + 32.0f) < 1e-4f);
+    expect(std::abs(test_subject.co_moment(1, 0) + 32.0f) < 1e-4f);
+    expect(std::abs(test_subject.co_moment(0, 2)) < 1e-6f);
+  };
+
+  "welford_accumulator::merge() matches a single accumulator"_test = []() {
+    // Setup
+    welford_accumulator first;
+    welford_accumulator second;
+    welford_accumulator expected;
+    for (std::int16_t x = 0; x < 100; x++) {
+      auto const value = static_cast<std::int16_t>(x * x % 37);
+      (x < 30 ? first : second).add(sample(value));
+      expected.add(sample(value));
+    }
+
+    // Exercise
+    first.merge(second);
+
+    // Verify
+    expect(that % expected.count() == first.count());
+    expect(std::abs(first.axis(0).mean - expected.axis(0).mean) < 1e-4f);
+    expect(std::abs(first.axis(0).m2 - expected.axis(0).m2) < 0.1f);
+    expect(that % expected.axis(0).min == first.axis(0).min);
+    expect(that % expected.axis(0).max == first.axis(0).max);
+    expect(std::abs(first.co_moment(0, 1) - expected.co_moment(0, 1)) < 0.1f);
+  };
+
+  "welford_accumulator::add() small variance on a large mean"_test = []() {
+    // Setup
+    welford_accumulator test_subject;
+
+    // Exercise
+    // +/-1 digit of noise on 2000 digits, where sum of squares would cancel
+    for (int i = 0; i < 100'000; i++) {
+      test_subject.add(sample(static_cast<std::int16_t>(2000 + i % 2 * 2 - 1)));
+    }
+
+    // Verify
+    auto const variance =
+      test_subject.axis(0).m2 / static_cast<float>(test_subject.count());
+    expect(std::abs(test_subject.axis(0).mean - 2000.0f) < 0.01f);
+    expect(std::abs(variance - 1.0f) < 0.01f) << variance;
+  };
+
+  "streaming_statistics::statistics() tumbling window"_test = []() {
+    // Setup
+    streaming_statistics test_subject(4);
+    std::array const samples{ sample(1000), sample(-1000),
+                              sample(1000), sample(-1000),
+                              sample(500) };
+
+    // Exercise
+    auto const moves = test_subject.add(samples);
+    auto const result = test_subject.statistics();
+
+    // Verify
+    expect(that % 1U == moves);
+    expect(that % true == test_subject.window_full());
+    expect(that % 4U == result.count);
+    // 1000 digits at 1mg per digit, the sample of the next block is excluded
+    expect(std::abs(result.x.mean) < 1e-6f);
+    expect(std::abs(result.x.rms - 1.0f) < 1e-5f) << result.x.rms;
+    expect(std::abs(result.x.variance - 4.0f / 3.0f) < 1e-5f);
+    expect(std::abs(result.x.min + 1.0f) < 1e-6f);
+    expect(std::abs(result.x.max - 1.0f) < 1e-6f);
+    expect(std::abs(result.z.mean - 1.0f) < 1e-6f);
+    expect(std::abs(result.z.rms - 1.0f) < 1e-6f);
+  };
+
+  "streaming_statistics::statistics() with a calibration"_test = []() {
+    // Setup
+    streaming_statistics test_subject(4);
+    lis3dhtr::calibration_model model{};
+    model.bias = { 0.0f, 0.0f, 0.1f };
+    // x + 0.5 * y, with y = -x
+    model.cross_axis[0][1] = 0.5f;
+    test_subject.configure_calibration(model);
+    std::array const samples{ sample(1000), sample(-1000),
+                              sample(1000), sample(-1000) };
+
+    // Exercise
+    test_subject.add(samples);
+    auto const result = test_subject.statistics();
+
+    // Verify
+    // x swings +/-0.5g once calibrated
+    expect(std::abs(result.x.mean) < 1e-6f);
+    expect(std::abs(result.x.rms - 0.5f) < 1e-5f) << result.x.rms;
+    expect(std::abs(result.x.variance - 1.0f / 3.0f) < 1e-5f);
+    // the extremes only take the diagonal
+    expect(std::abs(result.x.max - 1.0f) < 1e-6f);
+    expect(std::abs(result.z.mean - 0.9f) < 1e-6f);
+    expect(std::abs(result.z.rms - 0.9f) < 1e-6f);
+    expect(std::abs(result.z.min - 0.9f) < 1e-6f);
+  };
+
+  "streaming_statistics::statistics() sliding window"_test = []() {
+    // Setup
+    streaming_statistics<2> test_subject(2);
+    std::array const samples{ sample(100), sample(100), sample(200),
+                              sample(200), sample(300), sample(300) };
+
+    // Exercise
+    test_subject.add(std::span(samples).first(2));
+    auto const partial = test_subject.statistics();
+    auto const filled_early = test_subject.window_full();
+    test_subject.add(std::span(samples).subspan(2));
+    auto const result = test_subject.statistics();
+
+    // Verify
+    expect(that % false == filled_early);
+    expect(that % true == test_subject.window_full());
+    expect(that % 2U == partial.count);
+    expect(that % 4U == result.count);
+    // the block of 100s has slid out of the window
+    expect(std::abs(result.x.mean - 0.25f) < 1e-6f) << result.x.mean;
+    expect(std::abs(result.x.min - 0.2f) < 1e-6f);
+    expect(std::abs(result.x.max - 0.3f) < 1e-6f);
+  };
+
+  "streaming_statistics::add() restarts on a full scale change"_test = []() {
+    // Setup
+    streaming_statistics test_subject(2);
+    test_subject.add(sample(1000));
+    test_subject.add(sample(1000));
+
+    // Exercise
+    test_subject.add(sample(1000, lis3dhtr::max_acceleration::g4));
+    auto const pending = test_subject.window_full();
+    test_subject.add(sample(1000, lis3dhtr::max_acceleration::g4));
+    auto const result = test_subject.statistics();
+
+    // Verify
+    expect(that % false == pending);
+    expect(that % 2U == result.count);
+    // 2mg per digit at 4g
+    expect(std::abs(result.x.mean - 2.0f) < 1e-6f) << result.x.mean;
+  };
+};
+}  // namespace hal::stm_imu
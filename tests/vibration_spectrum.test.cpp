@@ -0,0 +1,229 @@
+// Copyright 2024 Khalil Estell
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <libhal-stm-imu/vibration_spectrum.hpp>
+
+namespace hal::stm_imu {
+namespace {
+constexpr std::size_t points = 256;
+
+/// a deterministic mix of tones and pseudo random noise, within +/-16384
+std::vector<std::int16_t> signal()
+{
+  std::vector<std::int16_t> samples(points);
+  std::uint32_t state = 1;
+  for (std::size_t n = 0; n < points; n++) {
+    state = state * 1664525U + 1013904223U;
+    auto const noise = static_cast<float>(state >> 20) - 2048.0f;
+    auto const phase = 2.0f * std::numbers::pi_v<float> * n / points;
+    samples[n] = static_cast<std::int16_t>(std::lround(
+      1000.0f + 6000.0f * std::sin(phase * 17.0f) +
+      3000.0f * std::cos(phase * 90.5f) + noise));
+  }
+  return samples;
+}
+
+float dft_magnitude(std::vector<std::int16_t> const& p_samples,
+                    std::size_t p_bin)
+{
+  std::complex<double> sum = 0.0;
+  for (std::size_t n = 0; n < p_samples.size(); n++) {
+    auto const angle = -2.0 * std::numbers::pi * p_bin * n / p_samples.size();
+    sum += static_cast<double>(p_samples[n]) * std::polar(1.0, angle);
+  }
+  return static_cast<float>(std::abs(sum));
+}
+
+/// the largest difference from the DFT, relative to the largest bin
+template<typename Fft>
+float fft_error(std::vector<std::int16_t> const& p_samples)
+{
+  Fft test_subject;
+  for (std::size_t n = 0; n < points; n++) {
+    test_subject.set(n, p_samples[n]);
+  }
+  test_subject.transform();
+
+  float peak = 0.0f;
+  float error = 0.0f;
+  for (std::size_t k = 0; k < Fft::bins; k++) {
+    auto const expected = dft_magnitude(p_samples, k);
+    peak = std::max(peak, expected);
+    error = std::max(error, std::abs(test_subject.magnitude(k) - expected));
+  }
+  return error / peak;
+}
+
+std::vector<lis3dhtr::raw_read_t> vibration(std::size_t p_count)
+{
+  std::vector<lis3dhtr::raw_read_t> samples(p_count);
+  for (std::size_t n = 0; n < p_count; n++) {
+    // 500mg centered on bin 32, on top of gravity on z
+    auto const phase = 2.0f * std::numbers::pi_v<float> * 32.0f * n / points;
+    samples[n] = lis3dhtr::raw_read_t{
+      .x = static_cast<std::int16_t>(std::lround(500.0f * std::sin(phase))),
+      .y = 0,
+      .z = 1000,
+      .full_scale = lis3dhtr::max_acceleration::g2,
+      .resolution = 12,
+    };
+  }
+  return samples;
+}
+
+template<typename Spectrum>
+void verify_spectrum()
+{
+  using namespace boost::ut;
+
+  // Setup
+  Spectrum test_subject;
+  auto const samples = vibration(points + 32);
+  std::size_t updates = 0;
+
+  // Exercise
+  // one call per FIFO burst
+  for (std::size_t offset = 0; offset < samples.size(); offset += 32) {
+    updates += test_subject.add(std::span(samples).subspan(offset, 32));
+  }
+
+  // Verify
+  auto const x = test_subject.magnitudes(0);
+  auto const z = test_subject.magnitudes(2);
+  expect(that % 1U == updates);
+  expect(that % 1U == test_subject.frames());
+  expect(std::abs(x[32] - 0.5f) < 0.005f) << x[32];
+  // the neighbors of a centered tone are 6dB down with a Hann window
+  expect(std::abs(x[31] - 0.25f) < 0.005f) << x[31];
+  expect(x[40] < 0.005f) << x[40];
+  expect(std::abs(z[0] - 1.0f) < 0.005f) << z[0];
+  // mean square of a 0.5g sinusoid
+  auto const energy = test_subject.band_energy(0, 30, 35);
+  expect(std::abs(energy - 0.125f) < 0.002f) << energy;
+  expect(test_subject.band_energy(0, 40, Spectrum::bins) < 0.0001f);
+}
+
+template<typename Spectrum>
+void verify_calibrated_spectrum()
+{
+  using namespace boost::ut;
+
+  // Setup
+  Spectrum test_subject;
+  lis3dhtr::calibration_model model{};
+  model.bias = { 0.0f, 0.0f, 0.1f };
+  // y picks up half of x
+  model.cross_axis[1][0] = 0.5f;
+  test_subject.configure_calibration(model);
+  auto const samples = vibration(points);
+
+  // Exercise
+  test_subject.add(samples);
+
+  // Verify
+  auto const x = test_subject.magnitudes(0);
+  auto const y = test_subject.magnitudes(1);
+  auto const z = test_subject.magnitudes(2);
+  expect(std::abs(x[32] - 0.5f) < 0.005f) << x[32];
+  expect(std::abs(y[32] - 0.25f) < 0.005f) << y[32];
+  // 1g - 0.1g, which the window also puts in bin 1
+  expect(std::abs(z[0] - 0.9f) < 0.005f) << z[0];
+  expect(std::abs(z[1] - 0.9f) < 0.005f) << z[1];
+  expect(z[2] < 0.005f) << z[2];
+}
+}  // namespace
+
+void vibration_spectrum_test()
+{
+  using namespace boost::ut;
+  using namespace std::literals;
+
+  "real_fft::transform() float matches the DFT"_test = []() {
+    auto const samples = signal();
+    auto const interleaved =
+      fft_error<real_fft<points, float, fft_layout::interleaved>>(samples);
+    auto const split =
+      fft_error<real_fft<points, float, fft_layout::split>>(samples);
+
+    expect(interleaved < 1e-5f) << interleaved;
+    expect(split < 1e-5f) << split;
+  };
+
+  "real_fft::transform() Q15 matches the DFT"_test = []() {
+    auto const samples = signal();
+    auto const interleaved =
+      fft_error<real_fft<points, std::int16_t, fft_layout::interleaved>>(
+        samples);
+    auto const split =
+      fft_error<real_fft<points, std::int16_t, fft_layout::split>>(samples);
+
+    // bins are scaled by 1/256, so each holds 8 fewer bits
+    expect(interleaved < 0.002f) << interleaved;
+    expect(split < 0.002f) << split;
+  };
+
+  "real_fft::transform() sizes"_test = []() {
+    auto const samples = signal();
+    std::vector<std::int16_t> longer(samples);
+    longer.insert(longer.end(), samples.begin(), samples.end());
+
+    real_fft<512> test_subject;
+    for (std::size_t n = 0; n < longer.size(); n++) {
+      test_subject.set(n, longer[n]);
+    }
+    test_subject.transform();
+
+    // a repeated frame only occupies the even bins
+    expect(std::abs(test_subject.magnitude(34) -
+                    2.0f * dft_magnitude(samples, 17)) < 1.0f);
+    expect(test_subject.magnitude(35) < 1.0f);
+  };
+
+  "vibration_spectrum::add() float"_test = []() {
+    verify_spectrum<vibration_spectrum<points>>();
+  };
+
+  "vibration_spectrum::add() Q15"_test = []() {
+    verify_spectrum<vibration_spectrum<points, std::int16_t>>();
+  };
+
+  "vibration_spectrum::add() interleaved layout"_test = []() {
+    verify_spectrum<
+      vibration_spectrum<points, float, fft_layout::interleaved>>();
+  };
+
+  "vibration_spectrum::add() with a calibration"_test = []() {
+    verify_calibrated_spectrum<vibration_spectrum<points>>();
+    verify_calibrated_spectrum<vibration_spectrum<points, std::int16_t>>();
+  };
+
+  "vibration_spectrum::bin()"_test = []() {
+    using spectrum = vibration_spectrum<1024>;
+
+    expect(that % 0U == spectrum::bin(0.0f, 400.0f));
+    // 400Hz / 1024 = 0.39Hz per bin
+    expect(that % 256U == spectrum::bin(100.0f, 400.0f));
+    // clamped to the Nyquist bin
+    expect(that % 512U == spectrum::bin(500.0f, 400.0f));
+  };
+};
+}  // namespace hal::stm_imu